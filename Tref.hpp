@@ -25,7 +25,12 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define TREF_H
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
@@ -43,10 +48,29 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #error "Need a c++17 compiler"
 #endif
 
+// C++20 path: consteval helpers and fixed-string template arguments.
+#if ZTrefCxxVersion >= 202002L
+#define ZTrefCxx20 1
+#define ZTrefConsteval consteval
+#else
+#define ZTrefCxx20 0
+#define ZTrefConsteval constexpr
+#endif
+
 #ifndef TrefMaxElems
 #define TrefMaxElems 255
 #endif
 
+// Store 32-bit hashes instead of the names of classes, fields and enum
+// items, to strip the name strings out of shipping builds.
+#ifndef TrefHashNames
+#define TrefHashNames 0
+#endif
+
+#if TrefHashNames
+#include <unordered_map>
+#endif
+
 namespace tref {
 namespace imp {
 
@@ -63,6 +87,110 @@ struct Type {
   using type = T;
 };
 
+template <typename T>
+inline constexpr char type_tag_v = 0;
+
+// Unique id of a type without RTTI.
+template <typename T>
+constexpr const void* type_id() {
+  return &type_tag_v<remove_cv_t<T>>;
+}
+
+// Names
+
+// FNV-1a, the hash of names when TrefHashNames is on.
+constexpr uint32_t name_hash(string_view s) {
+  uint32_t h = 2166136261u;
+  for (auto c : s)
+    h = (h ^ (uint8_t)c) * 16777619u;
+  return h;
+}
+
+#if TrefHashNames
+
+// Text of the hashed names, from the sidecar name table.
+inline unordered_map<uint32_t, string>& hashed_names() {
+  static unordered_map<uint32_t, string> names;
+  return names;
+}
+
+// A name replaced by its hash. Comparing with a string hashes the string, the
+// text is only known after load_name_table.
+struct HashedName {
+  uint32_t hash = 0;
+
+  constexpr HashedName() = default;
+  constexpr explicit HashedName(uint32_t h)
+      : hash{h} {}
+  constexpr HashedName(string_view s)
+      : hash{name_hash(s)} {}
+  constexpr HashedName(const char* s)
+      : hash{name_hash(s)} {}
+
+  // @return: empty if the name is not in the name table.
+  string_view str() const {
+    auto& names = hashed_names();
+    auto  it = names.find(hash);
+    return it == names.end() ? string_view{""} : string_view{it->second};
+  }
+
+  operator string_view() const { return str(); }
+  const char* data() const { return str().data(); }
+  size_t      size() const { return str().size(); }
+
+  // No name, like the empty result of enum_to_string.
+  constexpr bool empty() const { return hash == 0; }
+
+  friend constexpr bool operator==(HashedName a, HashedName b) { return a.hash == b.hash; }
+  friend constexpr bool operator!=(HashedName a, HashedName b) { return a.hash != b.hash; }
+  friend constexpr bool operator<(HashedName a, HashedName b) { return a.hash < b.hash; }
+  friend constexpr bool operator==(HashedName a, string_view b) { return a.hash == name_hash(b); }
+  friend constexpr bool operator!=(HashedName a, string_view b) { return a.hash != name_hash(b); }
+  friend constexpr bool operator==(string_view a, HashedName b) { return b == a; }
+  friend constexpr bool operator!=(string_view a, HashedName b) { return b != a; }
+  friend constexpr bool operator==(HashedName a, const char* b) { return a == string_view(b); }
+  friend constexpr bool operator!=(HashedName a, const char* b) { return a != string_view(b); }
+  friend constexpr bool operator==(const char* a, HashedName b) { return b == string_view(a); }
+  friend constexpr bool operator!=(const char* a, HashedName b) { return b != string_view(a); }
+
+  template <typename Os>
+  friend Os& operator<<(Os& os, HashedName n) {
+    return os << n.str();
+  }
+};
+
+using Name = HashedName;
+
+// Hashed at compile time, the string is never referenced at runtime.
+#define ZTrefName(s) \
+  tref::imp::HashedName { std::integral_constant<uint32_t, tref::imp::name_hash(s)>::value }
+
+// Load the `hash name` lines written by append_name_table in a build without
+// TrefHashNames.
+// NOTE: not thread safe, load it before looking up the names.
+inline void load_name_table(string_view text) {
+  while (!text.empty()) {
+    auto line = text.substr(0, text.find('\n'));
+    text.remove_prefix(min(text.size(), line.size() + 1));
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (line.size() < 10 || line[8] != ' ')
+      continue;
+    uint32_t h = 0;
+    for (auto c : line.substr(0, 8))
+      h = h * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    hashed_names()[h] = string(line.substr(9));
+  }
+}
+
+#else
+
+using Name = string_view;
+
+#define ZTrefName(s) s
+
+#endif
+
 template <size_t L, size_t... R>
 constexpr auto tail(index_sequence<L, R...>) {
   return index_sequence<R...>();
@@ -123,6 +251,22 @@ struct func_trait<R (C::*)(A...)> {
   using ret_t = R;
 };
 
+template <typename R, typename... A>
+struct func_trait<R (*)(A...)> {
+  using args_t = tuple<A...>;
+  static constexpr auto args_count = sizeof...(A);
+  using ret_t = R;
+};
+
+template <typename R, typename C, typename... A>
+struct func_trait<R (C::*)(A...) const noexcept> : func_trait<R (C::*)(A...) const> {};
+
+template <typename R, typename C, typename... A>
+struct func_trait<R (C::*)(A...) noexcept> : func_trait<R (C::*)(A...)> {};
+
+template <typename R, typename... A>
+struct func_trait<R (*)(A...) noexcept> : func_trait<R (*)(A...)> {};
+
 // function overloading helper
 
 template <typename... Args>
@@ -291,9 +435,49 @@ constexpr auto slot_data() {
   return get<1>(_tref_slot((C**)0, Tag{}, Slot<Idx>{}));
 }
 
+// Many items pushed into one slot, they are expanded when iterating slots.
+template <typename Tuple>
+struct SlotList {
+  Tuple items;
+};
+
+template <typename T>
+constexpr auto slot_items(const T& data) {
+  return make_tuple(data);
+}
+
+template <typename Tuple>
+constexpr auto slot_items(const SlotList<Tuple>& data) {
+  return data.items;
+}
+
+template <typename T, typename F>
+constexpr bool each_slot_item(const T& data, F&& f) {
+  return f(data);
+}
+
+template <typename Tuple, typename F>
+constexpr bool each_slot_item(const SlotList<Tuple>& data, F&& f) {
+  return tuple_for_each(data.items, f);
+}
+
+// Fields of ZTrefFields, indexes continue from the slot.
+template <typename... F>
+constexpr auto field_list(int first, F... f) {
+  auto i = first;
+  return SlotList<tuple<F...>>{{F{i++, f.name, f.value, f.meta}...}};
+}
+
+template <typename Base, typename... S>
+constexpr auto subclass_list(nullptr_t, S... s) {
+  static_assert((is_same_v<typename S::type::base_t, Base> && ...),
+                "subclasses must have the same base class");
+  return SlotList<tuple<S...>>{{s...}};
+}
+
 template <class C, class Tag, class F, size_t... Is>
 constexpr bool slots_data_fold(index_sequence<Is...>, F&& f) {
-  return (f(slot_data<C, Tag, Is>()) && ...);
+  return (each_slot_item(slot_data<C, Tag, Is>(), f) && ...);
 }
 
 template <typename C, typename Tag, typename F>
@@ -308,7 +492,7 @@ constexpr bool each_slots_data(F f) {
 
 template <class C, class Tag, size_t... Is>
 constexpr auto all_slots_data_fold(index_sequence<Is...>) {
-  return make_tuple(slot_data<C, Tag, Is>()...);
+  return tuple_cat(slot_items(slot_data<C, Tag, Is>())...);
 }
 
 template <typename C, typename Tag>
@@ -353,9 +537,140 @@ using class_info_t = decltype(class_info_v<T>);
 template <typename T>
 constexpr auto has_base_class_v = is_reflected_v<T> && !std::is_same_v<ZTrefBaseOf(T), DummyBase>;
 
-template <typename TP, size_t... I>
-constexpr auto unpack_subclass(TP, index_sequence<I...>) {
-  return tuple_cat(class_info<typename tuple_element_t<I, TP>::type>().get_subclasses()...);
+// Flattened lists, computed once per class instead of recursing into the
+// bases or the subclasses at every call.
+
+template <typename... L>
+struct ConcatTypes {
+  using type = tuple<>;
+};
+
+template <typename... A>
+struct ConcatTypes<tuple<A...>> {
+  using type = tuple<A...>;
+};
+
+template <typename... A, typename... B, typename... R>
+struct ConcatTypes<tuple<A...>, tuple<B...>, R...> : ConcatTypes<tuple<A..., B...>, R...> {};
+
+template <typename... L>
+using concat_t = typename ConcatTypes<L...>::type;
+
+// T and its bases, the level of a class is its index.
+template <typename T, bool = has_base_class_v<T>>
+struct BaseChain {
+  using type = tuple<Type<T>>;
+};
+
+template <typename T>
+struct BaseChain<T, true> {
+  using type = concat_t<tuple<Type<T>>, typename BaseChain<ZTrefBaseOf(T)>::type>;
+};
+
+template <typename T>
+using base_chain_t = typename BaseChain<T>::type;
+
+template <typename T>
+constexpr int class_depth_v = int(tuple_size_v<base_chain_t<T>>) - 1;
+
+template <typename T>
+using direct_subclasses_t = decltype(all_slots_data<T, SubclassTag>());
+
+// The direct subclasses first, then the subclasses of each direct one.
+template <typename TP>
+struct Subclasses;
+
+template <typename... S>
+struct Subclasses<tuple<Type<S>...>> {
+  using type = concat_t<tuple<Type<S>...>, typename Subclasses<direct_subclasses_t<S>>::type...>;
+};
+
+// The subclasses in depth-first order.
+template <typename TP>
+struct SubclassTree;
+
+template <typename... S>
+struct SubclassTree<tuple<Type<S>...>> {
+  using type = concat_t<concat_t<tuple<Type<S>>, typename SubclassTree<direct_subclasses_t<S>>::type>...>;
+};
+
+// NOTE: must be used in a template function.
+template <typename T>
+using subclasses_t = typename Subclasses<direct_subclasses_t<T>>::type;
+
+// NOTE: must be used in a template function.
+template <typename T>
+using subclass_tree_t = typename SubclassTree<direct_subclasses_t<T>>::type;
+
+template <typename T>
+constexpr auto flatten_fields();
+
+// Fields of T, fields of the bases first.
+template <typename T>
+constexpr auto class_fields_v = flatten_fields<T>();
+
+// Index the own fields 1, 2, ... in declaration order. Slot values can not
+// be used: a ZTrefField after ZTrefFields takes the slot following the group
+// and would collide with the indexes of the group.
+template <typename... F, size_t... I>
+constexpr auto index_fields(const tuple<F...>& f, index_sequence<I...>) {
+  return tuple<F...>{F{int(I) + 1, get<I>(f).name, get<I>(f).value, get<I>(f).meta}...};
+}
+
+template <typename T>
+constexpr auto own_fields() {
+  constexpr auto slots = all_slots_data<T, FieldTag>();
+  return index_fields(slots, make_index_sequence<tuple_size_v<decltype(slots)>>());
+}
+
+// Whether the hashes of the names differ when TrefHashNames is on: names are
+// only compared by hash so a collision would resolve a name to the wrong item.
+template <size_t N>
+constexpr bool unique_name_hashes(const array<Name, N>& names) {
+#if TrefHashNames
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = i + 1; j < N; j++)
+      if (names[i] == names[j])
+        return false;
+#endif
+  (void)names;
+  return true;
+}
+
+template <typename... F>
+constexpr bool unique_field_hashes(const tuple<F...>& fields) {
+  return apply([](const auto&... f) { return unique_name_hashes(array<Name, sizeof...(F)>{f.name...}); },
+               fields);
+}
+
+// NOTE: with TrefHashNames, a field can not have the name of a field of the
+// bases.
+template <typename T>
+constexpr auto flatten_fields() {
+  constexpr auto own = own_fields<T>();
+  if constexpr (has_base_class_v<T>) {
+    constexpr auto all = tuple_cat(class_fields_v<ZTrefBaseOf(T)>, own);
+    static_assert(unique_field_hashes(all), "two field names of the class have the same hash");
+    return all;
+  } else {
+    static_assert(unique_field_hashes(own), "two field names of the class have the same hash");
+    return own;
+  }
+}
+
+template <typename Tag, typename C, typename F>
+constexpr bool each_own_item(F&& f) {
+  if constexpr (is_same_v<Tag, FieldTag>)
+    return tuple_for_each(own_fields<C>(), f);
+  else
+    return each_slots_data<C, Tag>(f);
+}
+
+template <typename Tag, typename Chain, typename F, size_t... I>
+constexpr bool each_in_chain(F& f, int level, index_sequence<I...>) {
+  return (each_own_item<Tag, typename tuple_element_t<I, Chain>::type>(
+              [&](const auto& info) { return f(info, level + int(I)); }) &&
+          ...);
 }
 
 // Meta for Member
@@ -367,8 +682,8 @@ struct FieldInfo {
 
   static constexpr auto is_member_v = !is_same_v<enclosing_class_t, void>;
 
-  int         index;
-  string_view name;
+  int  index;
+  Name name;
 
   // Possible values:
   // 1. Address of member variables & functions
@@ -376,7 +691,7 @@ struct FieldInfo {
   T    value;
   Meta meta;
 
-  constexpr FieldInfo(int idx, string_view n, T a, Meta m)
+  constexpr FieldInfo(int idx, Name n, T a, Meta m)
       : index{idx}, name{n}, value{a}, meta{m} {}
 };
 
@@ -387,34 +702,24 @@ struct ClassInfo {
   using class_t = T;
   using base_t = Base;
 
-  string_view name;
-  size_t      size;
-  Type<Base>  base;
-  Meta        meta;
+  Name       name;
+  size_t     size;
+  Type<Base> base;
+  Meta       meta;
 
-  constexpr ClassInfo(T*, string_view n, size_t sz, Type<Base> b, Meta m)
+  constexpr ClassInfo(T*, Name n, size_t sz, Type<Base> b, Meta m)
       : name{n}, size{sz}, base{b}, meta{m} {
     if constexpr (!is_same_v<Base, DummyBase>) {
       static_assert(is_base_of_v<Base, class_t>, "invalid base class");
     }
   }
 
-  constexpr auto get_fields() const {
-    auto f = all_slots_data<T, FieldTag>();
-    if constexpr (!is_same_v<Base, DummyBase>) {
-      return tuple_cat(class_info<Base>().get_fields(), f);
-    } else {
-      return f;
-    }
-  }
+  constexpr auto get_fields() const { return class_fields_v<T>; }
 
   template <typename Tag, typename F>
   constexpr bool each(F&& f, int level = 0) const {
-    auto next = each_slots_data<T, Tag>([&](const auto& info) { return f(info, level); });
-    if (next)
-      if constexpr (!is_same_v<Base, DummyBase>)
-        return class_info<Base>().template each<Tag>(f, level + 1);
-    return next;
+    using Chain = base_chain_t<T>;
+    return each_in_chain<Tag, Chain>(f, level, make_index_sequence<tuple_size_v<Chain>>());
   }
 
   // Iterate through the members recursively.
@@ -436,10 +741,11 @@ struct ClassInfo {
   }
 
   constexpr auto get_field_index(string_view name) const {
+    Name key = name;
     int  idx = 0;
     bool found = false;
     tuple_for_each(get_fields(), [&](auto f) {
-      if (f.name == name) {
+      if (f.name == key) {
         found = true;
         return false;
       }
@@ -461,19 +767,19 @@ struct ClassInfo {
   // NOTE: must call this function in a template function.
   template <typename F>
   constexpr bool each_subclass(F&& f, int level = 0) const {
-    return each_slots_data<T, SubclassTag>([&](auto info) {
-      using S = typename decltype(info)::type;
-      return f(class_info<S>(), level) &&
-             class_info<S>().each_subclass(f, level + 1);
+    return tuple_for_each(subclass_tree_t<T>{}, [&](auto t) {
+      using S = typename decltype(t)::type;
+      return f(class_info<S>(), level + class_depth_v<S> - class_depth_v<T> - 1);
     });
   }
 
   // NOTE: must call this function in a template function.
   constexpr auto get_subclass_index(string_view name) const {
+    Name key = name;
     int  idx = 0;
     bool found = false;
     tuple_for_each(get_subclasses(), [&](auto t) {
-      if (class_info<typename decltype(t)::type>().name == name) {
+      if (class_info<typename decltype(t)::type>().name == key) {
         found = true;
         return false;
       }
@@ -523,21 +829,7 @@ struct ClassInfo {
   }
 
   // NOTE: must call this function in a template function.
-  constexpr auto get_subclasses() const {
-    constexpr auto f = all_slots_data<T, SubclassTag>();
-    constexpr int  cnt = tuple_size_v<decltype(f)>;
-    constexpr auto idx = make_index_sequence<cnt>();
-    if constexpr (cnt) {
-      auto sub = unpack_subclass(f, idx);
-      if constexpr (tuple_size_v<decltype(sub)>) {
-        return tuple_cat(f, sub);
-      } else {
-        return f;
-      }
-    } else {
-      return f;
-    }
-  }
+  constexpr auto get_subclasses() const { return subclasses_t<T>{}; }
 
   // NOTE: must call this function in a template function.
   constexpr auto get_direct_subclasses() const {
@@ -574,9 +866,6 @@ struct ClassInfo {
   }
 };
 
-template <typename T>
-constexpr auto class_fields_v = class_info_v<T>.get_fields();
-
 template <typename T, typename F>
 constexpr auto each_field(F&& f) {
   return tuple_for_each(class_fields_v<T>, f);
@@ -601,160 +890,1272 @@ T* create_subclass(int subclassId, Args&&... args) {
   return ret;
 };
 
-#define ZTrefClassMetaImp(T, Base, meta)                              \
-  constexpr auto _tref_class_info(ZTrefRemoveParen(T)**) {            \
-    return tref::imp::ClassInfo{                                      \
-        (ZTrefRemoveParen(T)*)0, ZTrefStringify(ZTrefRemoveParen(T)), \
-        sizeof(ZTrefRemoveParen(T)),                                  \
-        tref::imp::Type<ZTrefRemoveParen(Base)>{}, meta};             \
+// Subclass id stored in the object, see ZTrefSubclassId.
+// The root holds the id, subclasses only hold an empty setter which
+// overwrites it during construction (the most derived one wins).
+// The id always describes the object itself: copies are stamped again by
+// their own constructors and assignments never change it, so slicing a
+// subclass into a root object can not carry the id of the subclass.
+
+template <typename Root, typename S>
+struct SubclassId {
+  explicit SubclassId(S* self) { stamp(self); }
+
+  SubclassId(const SubclassId&) {
+    // recover the enclosing object from the address of this member.
+    alignas(S) static char buf[sizeof(S)];
+    auto offset = (char*)&(((S*)buf)->_tref_subclass_id) - buf;
+    stamp((S*)((char*)this - offset));
   }
 
-#define ZTrefClassMeta(T, Base, meta) friend ZTrefClassMetaImp(T, Base, meta)
-
-#define ZTrefPushFieldImp(T, Tag, name, val, meta) \
-  ZTrefSlotPush(T, Tag, tref::imp::FieldInfo{slot.value, name, val, meta})
-
-//////////////////////////////////////////////////////////////////////////
-///
-/// macros for class reflection
-///
-//////////////////////////////////////////////////////////////////////////
-
-// sub type
+  SubclassId& operator=(const SubclassId&) { return *this; }
 
-template <typename T, class = void_t<>>
-struct get_parent {
-  using type = DummyBase;
+ private:
+  static void stamp(S* self) {
+    static_cast<Root*>(self)->_tref_subclass_id.value = subclass_id<Root, S>;
+  }
 };
 
-template <typename T>
-struct get_parent<T, void_t<typename T::__base_of_child_t>> {
-  using type = typename T::__base_of_child_t;
+template <typename Root>
+struct SubclassId<Root, Root> {
+  // -1 means the object is exactly of the root type.
+  int value = -1;
+
+  explicit constexpr SubclassId(Root*) {}
+  constexpr SubclassId(const SubclassId&) {}
+  constexpr SubclassId& operator=(const SubclassId&) { return *this; }
 };
 
-// NOTE: needed only when you want to iterate all children from base class.
-#define ZTrefSubType(T) \
-  ZTrefSubTypeImp(T, (typename ZTrefRemoveParen(T)::base_t))
+template <typename Root>
+int get_subclass_id(const Root* p) {
+  return p->_tref_subclass_id.value;
+}
 
-// NOTE: can't put into class:
-// 1. template overloads to increase the id will not work on clang.
-// 1. friend function unrelated to the current class may be removed by clang.
-#define ZTrefSubTypeImp(T, Base)                                                      \
-  ZTrefSlotPush(Base, tref::imp::SubclassTag, tref::imp::Type<ZTrefRemoveParen(T)>{}) \
-      ZTrefAllowSemicolon(ZTrefRemoveParen(T))
+template <typename Root, typename S, typename F, typename R>
+R visit_thunk(Root* p, F& f) {
+  using P = conditional_t<is_const_v<Root>, const S, S>;
+  return f(*static_cast<P*>(p));
+}
 
-// fix lint issue: `TrefSubType(T);` : empty statement.
-#define ZTrefAllowSemicolon(...) using zUnused = std::void_t<__VA_ARGS__>
+template <typename Root, typename F, typename R, typename Subs, size_t... I>
+R visit_dispatch(Root* p, F& f, index_sequence<I...>) {
+  using B = remove_const_t<Root>;
+  static constexpr R (*table[])(Root*, F&) = {
+      &visit_thunk<Root, B, F, R>,
+      &visit_thunk<Root, typename tuple_element_t<I, Subs>::type, F, R>...};
+  return table[p->_tref_subclass_id.value + 1](p, f);
+}
 
+// Call f with the object casted to its exact type, using the id stored by
+// ZTrefSubclassId instead of virtual calls or dynamic_cast.
+// @param f: [](auto& obj) -> R, must return the same type for all subclasses.
 //
+// NOTE: must call this function in a template function.
+template <typename Root, typename F>
+decltype(auto) visit(Root* p, F&& f) {
+  using R = decltype(f(*p));
+  using Subs = decltype(class_info_v<remove_const_t<Root>>.get_subclasses());
+  return visit_dispatch<Root, F, R, Subs>(p, f, make_index_sequence<tuple_size_v<Subs>>());
+}
 
-#define ZTrefTypeCommon(T, Base, meta) \
- private:                              \
-  using this_t = ZTrefRemoveParen(T);  \
-                                       \
- public:                               \
-  using __base_of_child_t = this_t;    \
-  ZTrefClassMeta(T, Base, meta);
+// Clone
 
-// Just reflect the type.
+// Whether Root and all its subclasses declare their own ZTrefSubclassId, so
+// that visit dispatches to the exact type of every object.
+template <typename Root, typename... S>
+constexpr bool has_own_subclass_ids(tuple<Type<S>...>*) {
+  return is_same_v<decltype(Root::_tref_subclass_id), SubclassId<Root, Root>> &&
+         (is_same_v<decltype(S::_tref_subclass_id), SubclassId<Root, S>> && ...);
+}
 
-#define ZTrefType(T) ZTrefTypeWithMeta(T, nullptr)
-#define ZTrefTypeWithMeta(T, meta)                                          \
- public:                                                                    \
-  using base_t = typename tref::imp::get_parent<ZTrefRemoveParen(T)>::type; \
-  ZTrefTypeCommon(T, base_t, meta);
+// NOTE: must be used in a template function.
+template <typename Root>
+constexpr bool is_clonable_v =
+    has_own_subclass_ids<Root>((decltype(class_info_v<Root>.get_subclasses())*)nullptr);
+
+// Copy constructed, the classes having ZTrefSubclassId are never trivially
+// copyable since the copies are stamped with their own id.
+// NOTE: the memory from alloc is not released if the constructor throws,
+// meant for arenas released as a whole.
+template <typename S, typename Alloc>
+S* clone_as(const S& src, Alloc& alloc) {
+  void* mem = alloc(sizeof(S), alignof(S));
+  return mem ? new (mem) S(src) : nullptr;
+}
 
-// reflect member variable & function
+template <typename S, typename Alloc>
+S* move_as(S& src, Alloc& alloc) {
+  void* mem = alloc(sizeof(S), alignof(S));
+  return mem ? new (mem) S(std::move(src)) : nullptr;
+}
 
-#define ZTrefField1(t) ZTrefFieldWithMeta2(t, nullptr)
-#define ZTrefFieldWithMeta2(t, meta) ZTrefFieldWithMeta2Imp(this_t, t, meta)
-#define ZTrefFieldWithMeta2Imp(T, t, meta)               \
-  ZTrefPushFieldImp(T, tref::imp::FieldTag,              \
-                    ZTrefStringify(ZTrefRemoveParen(t)), \
-                    &T::ZTrefRemoveParen(t), meta)
+struct NewAlloc {
+  void* operator()(size_t size, size_t align) const {
+    return ::operator new(size, std::align_val_t(align));
+  }
+};
 
-// provide arguments for overloaded function
-#define ZTrefField2(t, sig) ZTrefFieldWithMeta3(t, sig, nullptr)
-#define ZTrefFieldWithMeta3(t, sig, meta) \
-  ZTrefFieldWithMeta3Imp(this_t, t, sig, meta)
+// Copy the object pointed by p as its exact type, dispatched by the id
+// stored by ZTrefSubclassId, without a virtual clone() in every class.
+// Every subclass of Root must declare the id, see is_clonable_v.
+// @param alloc: [](size_t size, size_t align) -> void*, nullptr on failure,
+// see clone_as for exceptions.
+// @return nullptr if p is null, the allocation failed or the exact type is
+// abstract.
+//
+// NOTE: must call this function in a template function.
+template <typename Root, typename Alloc>
+Root* clone(const Root* p, Alloc&& alloc) {
+  static_assert(is_clonable_v<Root>, "every subclass of Root needs its own ZTrefSubclassId(Root)");
+  if (!p)
+    return nullptr;
+  return visit(p, [&](auto& v) -> Root* {
+    using S = decay_t<decltype(v)>;
+    if constexpr (is_abstract_v<S>)
+      return nullptr;
+    else
+      return clone_as<S>(v, alloc);
+  });
+}
 
-#define ZTrefFieldWithMeta3Imp(T, t, sig, meta)                              \
-  ZTrefPushFieldImp(                                                         \
-      T, tref::imp::FieldTag, ZTrefStringify(ZTrefRemoveParen(t)),           \
-      tref::imp::overload_v<ZTrefRemoveParen(sig)>(&T::ZTrefRemoveParen(t)), \
-      meta)
+// Allocated by operator new, free it with delete.
+template <typename Root>
+Root* clone(const Root* p) {
+  static_assert(is_clonable_v<Root>, "every subclass of Root needs its own ZTrefSubclassId(Root)");
+  if (!p)
+    return nullptr;
+  return visit(p, [](auto& v) -> Root* {
+    using S = decay_t<decltype(v)>;
+    if constexpr (is_abstract_v<S>)
+      return nullptr;
+    else
+      return new S(v);
+  });
+}
 
-// auto select from ZTrefField1 or ZTrefField2 by argument count
-#define ZTrefFieldImp(...) \
-  ZTrefMsvcExpand(         \
-      ZTrefDelay(ZTrefChooseField, ZTrefCount(__VA_ARGS__))(__VA_ARGS__))
-#define ZTrefChooseField(N) ZTrefField##N
+// Like clone but move constructs the new object, leaving p moved-from.
+template <typename Root, typename Alloc>
+Root* clone_move(Root* p, Alloc&& alloc) {
+  static_assert(is_clonable_v<Root>, "every subclass of Root needs its own ZTrefSubclassId(Root)");
+  if (!p)
+    return nullptr;
+  return visit(p, [&](auto& v) -> Root* {
+    using S = decay_t<decltype(v)>;
+    if constexpr (is_abstract_v<S>)
+      return nullptr;
+    else
+      return move_as<S>(v, alloc);
+  });
+}
 
-#define ZTrefField(...) friend ZTrefFieldImp(__VA_ARGS__)
+template <typename Root>
+Root* clone_move(Root* p) {
+  static_assert(is_clonable_v<Root>, "every subclass of Root needs its own ZTrefSubclassId(Root)");
+  if (!p)
+    return nullptr;
+  return visit(p, [](auto& v) -> Root* {
+    using S = decay_t<decltype(v)>;
+    if constexpr (is_abstract_v<S>)
+      return nullptr;
+    else
+      return new S(std::move(v));
+  });
+}
 
-// auto select from ZTrefFieldWithMeta2 or ZTrefFieldWithMeta3 by argument
-// count
-#define ZTrefFieldWithMetaImp(...)                     \
-  ZTrefMsvcExpand(ZTrefDelay(ZTrefChooseFieldWithMeta, \
-                             ZTrefCount(__VA_ARGS__))(__VA_ARGS__))
-#define ZTrefChooseFieldWithMeta(N) ZTrefFieldWithMeta##N
+// Hook chain
 
-#define ZTrefFieldWithMeta(...) friend ZTrefFieldWithMetaImp(__VA_ARGS__)
+#ifndef TrefMaxHooks
+#define TrefMaxHooks 4
+#endif
 
-// reflect member type
-#define ZTrefMemberTypeImp(T) ZTrefMemberTypeWithMetaImp(T, nullptr)
-#define ZTrefMemberTypeWithMetaImp(T, meta)              \
-  ZTrefPushFieldImp(this_t, tref::imp::MemberTypeTag,    \
-                    ZTrefStringify(ZTrefRemoveParen(T)), \
-                    tref::imp::Type<ZTrefRemoveParen(T)>{}, meta)
+#if defined(__GNUC__) || defined(__clang__)
+#define ZTrefLikely(x) __builtin_expect(!!(x), 1)
+#define ZTrefNoInline __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define ZTrefLikely(x) (x)
+#define ZTrefNoInline __declspec(noinline)
+#else
+#define ZTrefLikely(x) (x)
+#define ZTrefNoInline
+#endif
 
-#define ZTrefMemberType(T) friend ZTrefMemberTypeImp(T)
-#define ZTrefMemberTypeWithMeta(T, meta) \
-  friend ZTrefMemberTypeWithMetaImp(T, meta)
+template <typename Self, typename R, typename... A>
+struct PostHookOf {
+  using type = void (*)(void* ctx, Self& self, R& ret, A&... args);
+};
 
-//////////////////////////////////////////////////////////////////////////
-///
-/// enum reflection
-///
-//////////////////////////////////////////////////////////////////////////
+template <typename Self, typename... A>
+struct PostHookOf<Self, void, A...> {
+  using type = void (*)(void* ctx, Self& self, A&... args);
+};
 
-struct EnumValueConvertor {
-  template <typename T>
-  constexpr explicit EnumValueConvertor(T v)
-      : value((size_t)v) {
-    static_assert(sizeof(T) <= sizeof(value));
-  }
+// Pass an argument to the method when post hooks still need it: by-value
+// arguments are copied unless they are move-only.
+template <typename A, typename V>
+constexpr decltype(auto) kept_arg(V& v) {
+  if constexpr (!is_reference_v<A> && is_copy_constructible_v<A>)
+    return static_cast<const A&>(v);
+  else
+    return static_cast<A&&>(v);
+}
 
-  template <typename U>
-  constexpr EnumValueConvertor& operator=(U) {
-    return *this;
-  }
+template <typename Self, typename R, typename... A>
+struct HookChainImp {
+  using ret_t = R;
+  using self_t = Self;
 
-  template <typename U>
-  constexpr operator U() {
-    static_assert(is_enum_v<U>);
-    return (U)value;
-  }
+  // Called before the method, can modify the arguments.
+  using PreHook = void (*)(void* ctx, Self& self, A&... args);
+  // Called after the method, can modify the return value.
+  using PostHook = typename PostHookOf<Self, R, A...>::type;
 
-  size_t value = 0;
-};
+  struct Hook {
+    PreHook  pre;
+    PostHook post;
+    void*    ctx;
+  };
 
-template <typename T, typename Meta>
-struct EnumItem {
-  char name[255]{};
-  T    value;
-  Meta meta;
+  template <typename F>
+  struct Call {
+    F     f;
+    void* ctx;
+  };
+
+  // Installed hooks.
+  Hook hooks[TrefMaxHooks];
+  int  count = 0;
+  // Non-null hooks in calling order, rebuilt on changes so the hooked call
+  // runs them back-to-back.
+  Call<PreHook>  pres[TrefMaxHooks];
+  Call<PostHook> posts[TrefMaxHooks];
+  int            npre = 0;
+  int            npost = 0;
+
+  // NOTE: not thread safe, install hooks before the hooked calls start.
+  // @return: false if the chain is full.
+  constexpr bool add(PreHook pre, PostHook post = nullptr, void* ctx = nullptr) {
+    if (count == TrefMaxHooks)
+      return false;
+    hooks[count++] = {pre, post, ctx};
+    rebuild();
+    return true;
+  }
 
-  constexpr EnumItem(string_view name, T value, Meta meta)
-      : value{value}, meta{meta} {
-    std::copy(name.data(), name.data() + name.size(), this->name);
+  constexpr bool remove(PreHook pre, PostHook post = nullptr, void* ctx = nullptr) {
+    for (int i = 0; i < count; i++) {
+      if (hooks[i].pre == pre && hooks[i].post == post && hooks[i].ctx == ctx) {
+        for (count--; i < count; i++)
+          hooks[i] = hooks[i + 1];
+        rebuild();
+        return true;
+      }
+    }
+    return false;
   }
 
-  constexpr string_view name_view() {
-    return name;
+  constexpr void clear() { count = npre = npost = 0; }
+  constexpr bool empty() const { return count == 0; }
+
+  // Pre hooks run in the installing order, post hooks in reverse order.
+  // Post hooks see the arguments as passed to the method.
+  template <auto M>
+  ZTrefNoInline R call_hooked(Self& self, A... args) {
+    for (auto c = pres; c != pres + npre; c++)
+      c->f(c->ctx, self, args...);
+    if (npost == 0)
+      return (self.*M)(std::forward<A>(args)...);
+    if constexpr (is_void_v<R>) {
+      (self.*M)(kept_arg<A>(args)...);
+      for (auto c = posts; c != posts + npost; c++)
+        c->f(c->ctx, self, args...);
+    } else {
+      R ret = (self.*M)(kept_arg<A>(args)...);
+      for (auto c = posts; c != posts + npost; c++)
+        c->f(c->ctx, self, ret, args...);
+      return ret;
+    }
+  }
+
+ private:
+  constexpr void rebuild() {
+    npre = npost = 0;
+    for (int i = 0; i < count; i++) {
+      if (hooks[i].pre)
+        pres[npre++] = {hooks[i].pre, hooks[i].ctx};
+      if (hooks[count - 1 - i].post)
+        posts[npost++] = {hooks[count - 1 - i].post, hooks[count - 1 - i].ctx};
+    }
   }
 };
 
+template <auto M, typename Self, typename R, typename... A>
+struct HookChainOf : HookChainImp<Self, R, A...> {
+  R operator()(Self& self, A... args) {
+    if (ZTrefLikely(this->count == 0))
+      return (self.*M)(std::forward<A>(args)...);
+    return this->template call_hooked<M>(self, std::forward<A>(args)...);
+  }
+};
+
+template <typename F>
+struct hook_chain_trait;
+
+template <typename C, typename R, typename... A>
+struct hook_chain_trait<R (C::*)(A...)> {
+  template <auto M>
+  using type = HookChainOf<M, C, R, A...>;
+};
+
+template <typename C, typename R, typename... A>
+struct hook_chain_trait<R (C::*)(A...) const> {
+  template <auto M>
+  using type = HookChainOf<M, const C, R, A...>;
+};
+
+template <typename C, typename R, typename... A>
+struct hook_chain_trait<R (C::*)(A...) noexcept> : hook_chain_trait<R (C::*)(A...)> {};
+
+template <typename C, typename R, typename... A>
+struct hook_chain_trait<R (C::*)(A...) const noexcept> : hook_chain_trait<R (C::*)(A...) const> {};
+
+template <auto M>
+struct HookChain : hook_chain_trait<decltype(M)>::template type<M> {};
+
+// The hook chain of method M, shared by all objects.
+template <auto M>
+inline HookChain<M> hook_chain_v{};
+
+// Call method M through its hook chain.
+template <auto M, typename C, typename... A>
+decltype(auto) call_hooked(C& self, A&&... args) {
+  return hook_chain_v<M>(self, std::forward<A>(args)...);
+}
+
+struct MetaHookableBase {};
+
+// Field meta of hookable methods, see ZTrefHookable.
+template <auto M>
+struct MetaHookable : MetaHookableBase {
+  static constexpr auto method = M;
+
+  static HookChain<M>& chain() { return hook_chain_v<M>; }
+};
+
+// Property path
+
+#ifndef TrefMaxPathSteps
+#define TrefMaxPathSteps 8
+#endif
+
+// Offset of a data member computed once from its member pointer.
+// NOTE: not for members of virtual base classes.
+template <typename C, typename M>
+size_t member_offset(M C::*mp) {
+  alignas(C) static char buf[sizeof(C)];
+  return size_t((char*)&(((C*)buf)->*mp) - buf);
+}
+
+template <typename T, class = void_t<>>
+struct is_dynamic_array : false_type {};
+template <typename T>
+struct is_dynamic_array<T, void_t<decltype(declval<T&>().data()), decltype(declval<T&>().size()),
+                                  typename T::value_type>>
+    : bool_constant<!is_array_v<T>> {};
+
+template <typename T, class = void_t<>>
+struct is_static_array : is_array<T> {};
+template <typename T>
+struct is_static_array<T, void_t<typename T::value_type, decltype(tuple_size<T>::value)>>
+    : true_type {};
+
+template <typename T>
+struct array_element {
+  using type = typename T::value_type;
+};
+template <typename T, size_t N>
+struct array_element<T[N]> {
+  using type = T;
+};
+
+template <typename T>
+constexpr size_t static_array_size() {
+  if constexpr (is_array_v<T>)
+    return extent_v<T>;
+  else
+    return tuple_size<T>::value;
+}
+
+template <typename A>
+void* dynamic_element(void* arr, size_t i) {
+  auto& a = *(A*)arr;
+  return i < (size_t)a.size() ? (void*)&a.data()[i] : nullptr;
+}
+
+struct PathStep {
+  // Added to the object pointer.
+  size_t offset = 0;
+  // Index into a dynamic array after the offset, null for the last step.
+  void* (*element)(void* arr, size_t i) = nullptr;
+  size_t index = 0;
+};
+
+// A property path resolved once into a chain of offsets & element lookups.
+template <typename T>
+struct CompiledPath {
+  PathStep    steps[TrefMaxPathSteps];
+  int         count = 0;
+  const void* value_type = nullptr;
+  size_t      value_size = 0;
+
+  bool valid() const { return count > 0; }
+
+  // @return: null if the path is invalid or an index is out of range.
+  void* resolve(T& root) const {
+    auto p = (char*)&root;
+    for (int i = 0; i < count; i++) {
+      p += steps[i].offset;
+      if (steps[i].element && !(p = (char*)steps[i].element(p, steps[i].index)))
+        return nullptr;
+    }
+    return count ? p : nullptr;
+  }
+
+  // @return: null if the type of the value is not V.
+  template <typename V>
+  V* get(T& root) const {
+    return value_type == type_id<V>() ? (V*)resolve(root) : nullptr;
+  }
+
+  template <typename V>
+  bool set(T& root, V&& v) const {
+    auto p = get<decay_t<V>>(root);
+    if (p)
+      *p = std::forward<V>(v);
+    return p != nullptr;
+  }
+
+  // @return: false if the path needs more than TrefMaxPathSteps steps.
+  bool add_offset(size_t offset) {
+    if (count == 0 || steps[count - 1].element) {
+      if (count == TrefMaxPathSteps)
+        return false;
+      steps[count++] = {};
+    }
+    steps[count - 1].offset += offset;
+    return true;
+  }
+};
+
+// Consume `[i]` suffixes of `path` for a value of type V.
+template <typename U, typename V>
+bool compile_path_index(string_view path, CompiledPath<U>& out);
+
+template <typename U, typename C>
+bool compile_path_from(string_view path, CompiledPath<U>& out) {
+  if (path.empty()) {
+    out.value_type = type_id<C>();
+    out.value_size = sizeof(C);
+    return true;
+  }
+  if constexpr (is_reflected_v<C>) {
+    if (path[0] == '.')
+      path.remove_prefix(1);
+    auto end = path.find_first_of(".[");
+    auto name = path.substr(0, end);
+    auto rest = end == string_view::npos ? string_view{} : path.substr(end);
+    auto idx = class_info_v<C>.get_field_index(name);
+    if (idx < 0)
+      return false;
+
+    auto found = false;
+    auto i = 0;
+    tuple_for_each(class_fields_v<C>, [&](auto info) {
+      if (i++ != idx)
+        return true;
+      using V = decltype(info.value);
+      if constexpr (is_member_object_pointer_v<V>) {
+        found = out.add_offset(member_offset(static_cast<member_t<V> C::*>(info.value))) &&
+                compile_path_index<U, remove_cv_t<member_t<V>>>(rest, out);
+      }
+      return false;
+    });
+    return found;
+  } else {
+    return path[0] == '[' && compile_path_index<U, C>(path, out);
+  }
+}
+
+template <typename U, typename V>
+bool compile_path_index(string_view path, CompiledPath<U>& out) {
+  if (path.empty() || path[0] != '[')
+    return compile_path_from<U, V>(path, out);
+
+  if constexpr (is_static_array<V>::value || is_dynamic_array<V>::value) {
+    using E = typename array_element<V>::type;
+    size_t i = 0, p = 1;
+    for (; p < path.size() && path[p] >= '0' && path[p] <= '9'; p++) {
+      size_t d = path[p] - '0';
+      if (i > (~size_t(0) - d) / 10)
+        return false;
+      i = i * 10 + d;
+    }
+    if (p == 1 || p >= path.size() || path[p] != ']')
+      return false;
+
+    if constexpr (is_static_array<V>::value) {
+      if (i >= static_array_size<V>() || !out.add_offset(i * sizeof(E)))
+        return false;
+    } else {
+      if (!out.add_offset(0))
+        return false;
+      out.steps[out.count - 1].element = &dynamic_element<V>;
+      out.steps[out.count - 1].index = i;
+    }
+    return compile_path_index<U, remove_cv_t<E>>(path.substr(p + 1), out);
+  } else {
+    return false;
+  }
+}
+
+// Resolve a path like `transform.pos.x` or `items[3].count` from T.
+// Names are looked up once, evaluating the compiled path only adds offsets
+// and indexes dynamic arrays (vector, string, ...).
+template <typename T>
+CompiledPath<T> compile_path(string_view path) {
+  CompiledPath<T> ret;
+  if (!compile_path_from<T, T>(path, ret)) {
+    ret.count = 0;
+  } else if (ret.count == 0) {
+    ret.add_offset(0);
+  }
+  return ret;
+}
+
+// Field layout
+
+// Overlays the bytes on an object to find the address of a member at compile
+// time, the object is never constructed.
+template <typename C>
+union OffsetProbe {
+  char bytes[sizeof(C)];
+  C    obj;
+
+  constexpr OffsetProbe() : bytes() {}
+#if ZTrefCxxVersion >= 202002L
+  constexpr ~OffsetProbe() {}
+#endif
+};
+
+// Offset usable in constant expressions when has_constexpr_layout_v<C>.
+// NOTE: not for members of virtual base classes.
+template <typename C, typename M>
+constexpr size_t field_offset(M C::*mp) {
+  OffsetProbe<C> p;
+  for (size_t i = 0; i < sizeof(C); i += alignof(M))
+    if ((const void*)&p.bytes[i] == (const void*)&(p.obj.*mp))
+      return i;
+  return size_t(-1);
+}
+
+// C++17 needs a trivial destructor to place the probe in constant evaluation.
+template <typename C>
+constexpr bool has_constexpr_layout_v =
+    !is_abstract_v<C> && (ZTrefCxxVersion >= 202002L || is_trivially_destructible_v<C>);
+
+enum class LayoutKind : uint8_t { Bool, Integer, Float, Enum, Pointer, Array, Class, Other };
+
+struct FieldLayout {
+  Name       name;
+  size_t     offset = 0;
+  size_t     size = 0;
+  size_t     align = 0;
+  LayoutKind kind = LayoutKind::Other;
+};
+
+template <typename V>
+constexpr LayoutKind layout_kind() {
+  if constexpr (is_same_v<V, bool>)
+    return LayoutKind::Bool;
+  else if constexpr (is_integral_v<V>)
+    return LayoutKind::Integer;
+  else if constexpr (is_floating_point_v<V>)
+    return LayoutKind::Float;
+  else if constexpr (is_enum_v<V>)
+    return LayoutKind::Enum;
+  else if constexpr (is_pointer_v<V>)
+    return LayoutKind::Pointer;
+  else if constexpr (is_array_v<V>)
+    return LayoutKind::Array;
+  else if constexpr (is_class_v<V>)
+    return LayoutKind::Class;
+  else
+    return LayoutKind::Other;
+}
+
+template <typename T>
+constexpr size_t data_field_count() {
+  size_t n = 0;
+  tuple_for_each(class_fields_v<T>, [&](const auto& f) {
+    n += is_member_object_pointer_v<decltype(f.value)>;
+    return true;
+  });
+  return n;
+}
+
+// Data members of T and its base classes, bases first.
+template <typename T, bool Constexpr>
+constexpr auto make_layout() {
+  array<FieldLayout, data_field_count<T>()> ret{};
+  size_t i = 0;
+  tuple_for_each(class_fields_v<T>, [&](const auto& f) {
+    using V = decltype(f.value);
+    if constexpr (is_member_object_pointer_v<V>) {
+      using M = member_t<V>;
+      auto mp = static_cast<M T::*>(f.value);
+      auto& l = ret[i++];
+      l.name = f.name;
+      if constexpr (Constexpr)
+        l.offset = field_offset(mp);
+      else
+        l.offset = member_offset(mp);
+      l.size = sizeof(M);
+      l.align = alignof(M);
+      l.kind = layout_kind<remove_cv_t<M>>();
+    }
+    return true;
+  });
+  return ret;
+}
+
+template <typename T, bool = has_constexpr_layout_v<T>>
+struct LayoutOf {
+  static constexpr auto value = make_layout<T, true>();
+};
+
+// Offsets are computed at static initialization for the others.
+template <typename T>
+struct LayoutOf<T, false> {
+  static inline const auto value = make_layout<T, false>();
+};
+
+// std::array of FieldLayout, usable in constant expressions if
+// has_constexpr_layout_v<T>.
+template <typename T>
+constexpr auto& layout_v = LayoutOf<T>::value;
+
+// Layout analysis
+
+#ifndef TrefCachelineSize
+#define TrefCachelineSize 64
+#endif
+
+struct LayoutStats {
+  size_t size = 0;
+  // Bytes of the reflected data members.
+  size_t used = 0;
+  // Members not reflected are counted as padding, the vtable pointer is not.
+  size_t padding = 0;
+  // Size with the fields ordered by decreasing alignment.
+  size_t packed_size = 0;
+  // Fields touching more cache lines than needed.
+  size_t split_fields = 0;
+};
+
+constexpr size_t align_up(size_t n, size_t a) {
+  return (n + a - 1) / a * a;
+}
+
+// Assume the object starts at a cache line boundary.
+constexpr bool splits_cacheline(const FieldLayout& f) {
+  if (!f.size)
+    return false;
+  auto lines = (f.offset + f.size - 1) / TrefCachelineSize - f.offset / TrefCachelineSize + 1;
+  return lines > align_up(f.size, TrefCachelineSize) / TrefCachelineSize;
+}
+
+// The fields ordered by decreasing alignment with their offsets in that
+// order. Sizes are multiples of alignments so no padding is left between
+// them, the smallest layout. Base class boundaries are ignored.
+template <size_t N>
+constexpr array<FieldLayout, N> packed_layout(const array<FieldLayout, N>& fields, size_t hidden) {
+  array<FieldLayout, N> ret{};
+  for (size_t i = 0; i < N; i++) {
+    // Stable insertion sort.
+    auto j = i;
+    for (; j > 0 && ret[j - 1].align < fields[i].align; j--)
+      ret[j] = ret[j - 1];
+    ret[j] = fields[i];
+  }
+  auto end = hidden;
+  for (auto& f : ret) {
+    f.offset = align_up(end, f.align);
+    end = f.offset + f.size;
+  }
+  return ret;
+}
+
+template <size_t N>
+constexpr LayoutStats layout_stats(const array<FieldLayout, N>& fields, size_t size, size_t align,
+                                   size_t hidden) {
+  LayoutStats s;
+  s.size = size;
+  for (auto& f : fields) {
+    s.used += f.size;
+    s.split_fields += splits_cacheline(f);
+  }
+  s.padding = size - hidden - s.used;
+
+  auto packed = packed_layout(fields, hidden);
+  auto end = N ? packed[N - 1].offset + packed[N - 1].size : hidden;
+  s.packed_size = align_up(end ? end : 1, align);
+  return s;
+}
+
+template <typename T>
+LayoutStats layout_stats_of() {
+  return layout_stats(layout_v<T>, sizeof(T), alignof(T), is_polymorphic_v<T> ? sizeof(void*) : 0);
+}
+
+template <typename T>
+constexpr auto layout_stats_v =
+    layout_stats(layout_v<T>, sizeof(T), alignof(T), is_polymorphic_v<T> ? sizeof(void*) : 0);
+
+// Wasted bytes of T, usable in static_assert if has_constexpr_layout_v<T>.
+template <typename T>
+constexpr size_t padding_bytes_v = layout_stats_v<T>.padding;
+
+template <typename T>
+constexpr size_t packed_size_v = layout_stats_v<T>.packed_size;
+
+// Suggested field order of T, see packed_layout.
+template <typename T>
+constexpr auto packed_layout_v = packed_layout(layout_v<T>, is_polymorphic_v<T> ? sizeof(void*) : 0);
+
+// static_assert(tref::assert_no_cacheline_split<T, &T::f>);
+template <typename T, auto M>
+constexpr bool assert_no_cacheline_split = [] {
+  using V = member_t<decltype(M)>;
+  constexpr FieldLayout f{{}, field_offset(static_cast<V T::*>(M)), sizeof(V), alignof(V)};
+  static_assert(!splits_cacheline(f), "field splits a cache line");
+  return true;
+}();
+
+template <typename T>
+void layout_report_of(string& out) {
+  auto s = layout_stats_of<T>();
+  out.append(class_info<T>().name)
+      .append(": size ")
+      .append(to_string(s.size))
+      .append(", padding ")
+      .append(to_string(s.padding))
+      .append(", packed ")
+      .append(to_string(s.packed_size))
+      .append("\n");
+
+  auto fields = layout_v<T>;
+  sort(fields.begin(), fields.end(),
+       [](const FieldLayout& a, const FieldLayout& b) { return a.offset < b.offset; });
+
+  size_t end = is_polymorphic_v<T> ? sizeof(void*) : 0;
+  auto   gap = [&](size_t to) {
+    if (to > end)
+      out.append("  +").append(to_string(end)).append(" ").append(to_string(to - end)).append(
+          " bytes padding\n");
+  };
+  for (auto& f : fields) {
+    gap(f.offset);
+    out.append("  +").append(to_string(f.offset)).append(" ").append(f.name).append(": ").append(
+        to_string(f.size));
+    out.append(splits_cacheline(f) ? " bytes, splits cache line\n" : " bytes\n");
+    end = max(end, f.offset + f.size);
+  }
+  gap(s.size);
+
+  if (s.packed_size < s.size) {
+    out.append("  packed order:");
+    for (auto& f : packed_layout(layout_v<T>, is_polymorphic_v<T> ? sizeof(void*) : 0))
+      out.append(" ").append(f.name);
+    out.append(", ").append(to_string(s.packed_size)).append(" bytes\n");
+  }
+}
+
+// Layout of T and all its subclasses, one block per class.
+// NOTE: must call this function in a template function.
+template <typename T>
+string layout_report() {
+  string out;
+  layout_report_of<T>(out);
+  class_info<T>().each_subclass([&](auto info, int) {
+    layout_report_of<typename decltype(info)::class_t>(out);
+    return true;
+  });
+  return out;
+}
+
+// Field mapping
+
+// Class meta of the target of convert: every data member of it must be
+// matched by a data member of the source, checked at compile time. Unmatched
+// members are left untouched without it.
+struct MetaConvertStrict {};
+
+template <typename From, typename To>
+void convert_into(const From& from, To& to);
+
+template <typename From, typename To>
+constexpr bool is_value_convertible() {
+  if constexpr (is_assignable_v<To&, const From&>)
+    return true;
+  else
+    return !is_const_v<To> && is_reflected_v<From> && is_reflected_v<To>;
+}
+
+// Index of the data member of T named `name` in class_fields_v<T>, -1 if none.
+template <typename T>
+constexpr int data_field_index(Name name) {
+  int idx = -1, i = 0;
+  tuple_for_each(class_fields_v<T>, [&](const auto& f) {
+    if (is_member_object_pointer_v<decltype(f.value)> && f.name == name) {
+      idx = i;
+      return false;
+    }
+    i++;
+    return true;
+  });
+  return idx;
+}
+
+struct FieldMatch {
+  bool data = false;   // data member of the target
+  int  from = -1;      // index in class_fields_v<From>, -1 if unmatched
+  bool bytes = false;  // copied by a memcpy run
+};
+
+template <typename From, typename To, size_t I>
+constexpr FieldMatch match_field() {
+  FieldMatch     m;
+  constexpr auto tf = get<I>(class_fields_v<To>);
+  using TV = decltype(tf.value);
+  if constexpr (is_member_object_pointer_v<TV>) {
+    m.data = true;
+    constexpr int J = data_field_index<From>(tf.name);
+    if constexpr (J >= 0) {
+      using TM = member_t<TV>;
+      using FM = member_t<decltype(get<J>(class_fields_v<From>).value)>;
+      if constexpr (is_value_convertible<FM, TM>()) {
+        m.from = J;
+        m.bytes = is_same_v<remove_cv_t<FM>, TM> && is_trivially_copyable_v<TM>;
+      }
+    }
+  }
+  return m;
+}
+
+template <typename From, typename To, size_t... I>
+constexpr auto make_field_matches(index_sequence<I...>) {
+  return array<FieldMatch, sizeof...(I)>{match_field<From, To, I>()...};
+}
+
+// Matched source field of each field of To, indexed by the field index.
+template <typename From, typename To>
+constexpr auto field_matches_v =
+    make_field_matches<From, To>(make_index_sequence<tuple_size_v<decltype(class_fields_v<To>)>>());
+
+template <typename From, typename To>
+constexpr size_t unmatched_fields_v = [] {
+  size_t n = 0;
+  for (auto& m : field_matches_v<From, To>)
+    n += m.data && m.from < 0;
+  return n;
+}();
+
+struct CopyRun {
+  size_t dst = 0, src = 0, size = 0;
+};
+
+template <size_t N>
+struct CopyRuns {
+  array<CopyRun, N> runs{};
+  size_t            count = 0;
+
+  constexpr void add(size_t dst, size_t src, size_t size) {
+    if (count) {
+      auto& r = runs[count - 1];
+      if (dst == r.dst + r.size && src == r.src + r.size) {
+        r.size += size;
+        return;
+      }
+    }
+    runs[count++] = {dst, src, size};
+  }
+};
+
+template <typename From, typename To, bool Constexpr, size_t I, typename Runs>
+constexpr void add_copy_run(Runs& runs) {
+  if constexpr (field_matches_v<From, To>[I].bytes) {
+    constexpr auto tf = get<I>(class_fields_v<To>);
+    constexpr auto ff = get<field_matches_v<From, To>[I].from>(class_fields_v<From>);
+    using M = member_t<decltype(tf.value)>;
+    auto dst = static_cast<M To::*>(tf.value);
+    auto src = static_cast<const M From::*>(ff.value);
+    if constexpr (Constexpr)
+      runs.add(field_offset(dst), field_offset(src), sizeof(M));
+    else
+      runs.add(member_offset(dst), member_offset(src), sizeof(M));
+  }
+}
+
+// Byte copied fields adjacent in both classes are merged into one run, gaps
+// are never copied since they may hold members not reflected.
+template <typename From, typename To, bool Constexpr, size_t... I>
+constexpr auto make_copy_runs(index_sequence<I...>) {
+  CopyRuns<sizeof...(I)> runs;
+  (add_copy_run<From, To, Constexpr, I>(runs), ...);
+  return runs;
+}
+
+template <typename From, typename To,
+          bool = has_constexpr_layout_v<From> && has_constexpr_layout_v<To>>
+struct CopyRunsOf {
+  static constexpr auto value = make_copy_runs<From, To, true>(
+      make_index_sequence<tuple_size_v<decltype(class_fields_v<To>)>>());
+};
+
+// Offsets are computed at static initialization for the others.
+template <typename From, typename To>
+struct CopyRunsOf<From, To, false> {
+  static inline const auto value = make_copy_runs<From, To, false>(
+      make_index_sequence<tuple_size_v<decltype(class_fields_v<To>)>>());
+};
+
+// memcpy ranges used by convert, usable in constant expressions if both
+// classes has_constexpr_layout_v.
+template <typename From, typename To>
+constexpr auto& copy_runs_v = CopyRunsOf<From, To>::value;
+
+template <typename From, typename To, size_t I>
+void convert_field(const From& from, To& to) {
+  constexpr auto m = field_matches_v<From, To>[I];
+  if constexpr (m.from >= 0 && !m.bytes) {
+    constexpr auto tf = get<I>(class_fields_v<To>);
+    constexpr auto ff = get<m.from>(class_fields_v<From>);
+    using TM = member_t<decltype(tf.value)>;
+    using FM = member_t<decltype(ff.value)>;
+    auto&       dst = to.*static_cast<TM To::*>(tf.value);
+    const auto& src = from.*static_cast<FM From::*>(ff.value);
+    if constexpr (is_assignable_v<TM&, const FM&>)
+      dst = src;
+    else
+      convert_into(src, dst);
+  }
+}
+
+template <typename From, typename To, size_t... I>
+void convert_fields(const From& from, To& to, index_sequence<I...>) {
+  auto& runs = copy_runs_v<From, To>;
+  for (size_t i = 0; i < runs.count; i++) {
+    auto& r = runs.runs[i];
+    memcpy(reinterpret_cast<char*>(&to) + r.dst, reinterpret_cast<const char*>(&from) + r.src,
+           r.size);
+  }
+  (convert_field<From, To, I>(from, to), ...);
+}
+
+// Assign the data members of `to` from the data members of `from` having the
+// same name, including the base classes. The pairs are matched at compile
+// time: members of the same trivially copyable type are copied by memcpy,
+// merged into ranges when adjacent in both classes, the others are assigned,
+// or converted recursively for different reflected classes.
+// @see MetaConvertStrict
+template <typename From, typename To>
+void convert_into(const From& from, To& to) {
+  static_assert(!is_convertible_v<decltype(class_info_v<To>.meta), MetaConvertStrict> ||
+                    unmatched_fields_v<From, To> == 0,
+                "unmatched fields in the target with MetaConvertStrict");
+  convert_fields(from, to, make_index_sequence<tuple_size_v<decltype(class_fields_v<To>)>>());
+}
+
+// @return: a value-initialized To assigned by convert_into.
+template <typename To, typename From>
+To convert(const From& from) {
+  To to{};
+  convert_into(from, to);
+  return to;
+}
+
+#define ZTrefClassMetaImp(T, Base, meta)                                         \
+  constexpr auto _tref_class_info(ZTrefRemoveParen(T)**) {                       \
+    return tref::imp::ClassInfo{                                                 \
+        (ZTrefRemoveParen(T)*)0, ZTrefName(ZTrefStringify(ZTrefRemoveParen(T))), \
+        sizeof(ZTrefRemoveParen(T)),                                             \
+        tref::imp::Type<ZTrefRemoveParen(Base)>{}, meta};                        \
+  }
+
+#define ZTrefClassMeta(T, Base, meta) friend ZTrefClassMetaImp(T, Base, meta)
+
+#define ZTrefPushFieldImp(T, Tag, name, val, meta) \
+  ZTrefSlotPush(T, Tag, tref::imp::FieldInfo{slot.value, name, val, meta})
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// macros for class reflection
+///
+//////////////////////////////////////////////////////////////////////////
+
+// sub type
+
+template <typename T, class = void_t<>>
+struct get_parent {
+  using type = DummyBase;
+};
+
+template <typename T>
+struct get_parent<T, void_t<typename T::__base_of_child_t>> {
+  using type = typename T::__base_of_child_t;
+};
+
+// NOTE: needed only when you want to iterate all children from base class.
+#define ZTrefSubType(T) \
+  ZTrefSubTypeImp(T, (typename ZTrefRemoveParen(T)::base_t))
+
+// NOTE: can't put into class:
+// 1. template overloads to increase the id will not work on clang.
+// 1. friend function unrelated to the current class may be removed by clang.
+#define ZTrefSubTypeImp(T, Base)                                                      \
+  ZTrefSlotPush(Base, tref::imp::SubclassTag, tref::imp::Type<ZTrefRemoveParen(T)>{}) \
+      ZTrefAllowSemicolon(ZTrefRemoveParen(T))
+
+// Register subclasses of the same base by one slot, much cheaper to compile
+// than one ZTrefSubType per subclass in big hierarchies.
+#define ZTrefSubTypes(...) \
+  ZTrefSubTypesImp((typename ZTrefRemoveParen(ZTrefFirst(__VA_ARGS__))::base_t), __VA_ARGS__)
+#define ZTrefSubTypesImp(Base, ...)                                                               \
+  ZTrefSlotPush(Base, tref::imp::SubclassTag,                                                     \
+                tref::imp::subclass_list<ZTrefRemoveParen(Base)>(                                 \
+                    nullptr ZTrefMsvcExpand(ZTrefMap(ZTrefSubTypesItem, _, __VA_ARGS__))))       \
+      ZTrefAllowSemicolon(ZTrefRemoveParen(Base))
+#define ZTrefSubTypesItem(_, T) , tref::imp::Type<ZTrefRemoveParen(T)>{}
+
+// fix lint issue: `TrefSubType(T);` : empty statement.
+#define ZTrefAllowSemicolon(...) using zUnused = std::void_t<__VA_ARGS__>
+
+// Store the subclass id of Root in the object to support tref::visit.
+// NOTE: put it in the root and every subclass after ZTrefType, subclasses
+// without it are visited as their nearest ancestor having it.
+// NOTE: copies are stamped with the id of their own type, even a slicing copy,
+// by a user-provided copy constructor, so the class is not trivially copyable
+// any more: no memcpy of the objects, is_trivially_copyable_v is false.
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(no_unique_address)
+#define ZTrefNoUniqueAddress [[no_unique_address]]
+#endif
+#endif
+#ifndef ZTrefNoUniqueAddress
+#define ZTrefNoUniqueAddress
+#endif
+
+#define ZTrefSubclassId(Root)                                                \
+  ZTrefNoUniqueAddress tref::imp::SubclassId<ZTrefRemoveParen(Root), this_t> \
+      _tref_subclass_id{this}
+
+//
+
+#define ZTrefTypeCommon(T, Base, meta) \
+ private:                              \
+  using this_t = ZTrefRemoveParen(T);  \
+                                       \
+ public:                               \
+  using __base_of_child_t = this_t;    \
+  ZTrefClassMeta(T, Base, meta);
+
+// Just reflect the type.
+
+#define ZTrefType(T) ZTrefTypeWithMeta(T, nullptr)
+#define ZTrefTypeWithMeta(T, meta)                                          \
+ public:                                                                    \
+  using base_t = typename tref::imp::get_parent<ZTrefRemoveParen(T)>::type; \
+  ZTrefTypeCommon(T, base_t, meta);
+
+// reflect member variable & function
+
+#define ZTrefField1(t) ZTrefFieldWithMeta2(t, nullptr)
+#define ZTrefFieldWithMeta2(t, meta) ZTrefFieldWithMeta2Imp(this_t, t, meta)
+#define ZTrefFieldWithMeta2Imp(T, t, meta)                          \
+  ZTrefPushFieldImp(T, tref::imp::FieldTag,                         \
+                    ZTrefName(ZTrefStringify(ZTrefRemoveParen(t))), \
+                    &T::ZTrefRemoveParen(t), meta)
+
+// provide arguments for overloaded function
+#define ZTrefField2(t, sig) ZTrefFieldWithMeta3(t, sig, nullptr)
+#define ZTrefFieldWithMeta3(t, sig, meta) \
+  ZTrefFieldWithMeta3Imp(this_t, t, sig, meta)
+
+#define ZTrefFieldWithMeta3Imp(T, t, sig, meta)                                 \
+  ZTrefPushFieldImp(                                                            \
+      T, tref::imp::FieldTag, ZTrefName(ZTrefStringify(ZTrefRemoveParen(t))),   \
+      tref::imp::overload_v<ZTrefRemoveParen(sig)>(&T::ZTrefRemoveParen(t)),    \
+      meta)
+
+// auto select from ZTrefField1 or ZTrefField2 by argument count
+#define ZTrefFieldImp(...) \
+  ZTrefMsvcExpand(         \
+      ZTrefDelay(ZTrefChooseField, ZTrefCount(__VA_ARGS__))(__VA_ARGS__))
+#define ZTrefChooseField(N) ZTrefField##N
+
+#define ZTrefField(...) friend ZTrefFieldImp(__VA_ARGS__)
+
+// auto select from ZTrefFieldWithMeta2 or ZTrefFieldWithMeta3 by argument
+// count
+#define ZTrefFieldWithMetaImp(...)                     \
+  ZTrefMsvcExpand(ZTrefDelay(ZTrefChooseFieldWithMeta, \
+                             ZTrefCount(__VA_ARGS__))(__VA_ARGS__))
+#define ZTrefChooseFieldWithMeta(N) ZTrefFieldWithMeta##N
+
+#define ZTrefFieldWithMeta(...) friend ZTrefFieldWithMetaImp(__VA_ARGS__)
+
+// Reflect plain member variables & functions by one slot, much cheaper to
+// compile than one ZTrefField per member in big classes. Can be mixed with
+// ZTrefField in any order.
+#define ZTrefFields(...)                                                         \
+  friend ZTrefSlotPush(this_t, tref::imp::FieldTag,                              \
+                       tref::imp::field_list(slot.value ZTrefMsvcExpand(         \
+                           ZTrefMap(ZTrefFieldsItem, this_t, __VA_ARGS__))))
+#define ZTrefFieldsItem(T, t) \
+  , tref::imp::FieldInfo{0, ZTrefName(ZTrefStringify(ZTrefRemoveParen(t))), &T::ZTrefRemoveParen(t), nullptr}
+
+// Reflect a method which can be hooked, call it by tref::call_hooked.
+#define ZTrefHookable(t) \
+  ZTrefFieldWithMeta(t, tref::imp::MetaHookable<&this_t::ZTrefRemoveParen(t)>{})
+
+// reflect member type
+#define ZTrefMemberTypeImp(T) ZTrefMemberTypeWithMetaImp(T, nullptr)
+#define ZTrefMemberTypeWithMetaImp(T, meta)                         \
+  ZTrefPushFieldImp(this_t, tref::imp::MemberTypeTag,               \
+                    ZTrefName(ZTrefStringify(ZTrefRemoveParen(T))), \
+                    tref::imp::Type<ZTrefRemoveParen(T)>{}, meta)
+
+#define ZTrefMemberType(T) friend ZTrefMemberTypeImp(T)
+#define ZTrefMemberTypeWithMeta(T, meta) \
+  friend ZTrefMemberTypeWithMetaImp(T, meta)
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// enum reflection
+///
+//////////////////////////////////////////////////////////////////////////
+
+struct EnumValueConvertor {
+  template <typename T>
+  constexpr explicit EnumValueConvertor(T v)
+      : value((size_t)v) {
+    static_assert(sizeof(T) <= sizeof(value));
+  }
+
+  template <typename U>
+  constexpr EnumValueConvertor& operator=(U) {
+    return *this;
+  }
+
+  template <typename U>
+  constexpr operator U() {
+    static_assert(is_enum_v<U>);
+    return (U)value;
+  }
+
+  size_t value = 0;
+};
+
+ZTrefConsteval string_view enum_trim_name(string_view s) {
+  auto p = s.find_first_of('=');
+  if (p != string_view::npos)
+    p = s.rfind(' ', p);
+  return s.substr(0, p);
+}
+
+#if TrefHashNames
+
+#define ZTrefEnumItemName(s) ZTrefName(tref::imp::enum_trim_name(s))
+
+template <typename T, typename Meta>
+struct EnumItem {
+  Name name;
+  T    value;
+  Meta meta;
+
+  constexpr EnumItem(Name name, T value, Meta meta)
+      : name{name}, value{value}, meta{meta} {}
+
+  constexpr Name name_view() const {
+    return name;
+  }
+};
+
+#elif ZTrefCxx20
+
+template <size_t N>
+struct FixedString {
+  char data[N]{};
+
+  consteval FixedString(const char (&s)[N]) {
+    for (size_t i = 0; i < N; i++)
+      data[i] = s[i];
+  }
+};
+
+// Trimmed item names as null terminated strings, one copy per name.
+template <FixedString S>
+inline constexpr auto enum_name_v = [] {
+  auto ret = S;
+  auto n = enum_trim_name(S.data).size();
+  for (auto i = n; i < sizeof(ret.data); i++)
+    ret.data[i] = 0;
+  return ret;
+}();
+
+#define ZTrefEnumItemName(s) tref::imp::enum_name_v<s>.data
+
+template <typename T, typename Meta>
+struct EnumItem {
+  const char* name;
+  T           value;
+  Meta        meta;
+
+  constexpr EnumItem(const char* name, T value, Meta meta)
+      : name{name}, value{value}, meta{meta} {}
+
+  constexpr string_view name_view() const {
+    return name;
+  }
+};
+
+#else
+
+#define ZTrefEnumItemName(s) tref::imp::enum_trim_name(s)
+
+// NOTE: names must be shorter than 255 characters, always nul-terminated.
+template <typename T, typename Meta>
+struct EnumItem {
+  char    name[255]{};
+  uint8_t name_size = 0;
+  T       value;
+  Meta    meta;
+
+  constexpr EnumItem(string_view name, T value, Meta meta)
+      : name_size{uint8_t(name.size())}, value{value}, meta{meta} {
+    if (name.size() >= sizeof(this->name))
+      throw "enum item name too long";
+    // std::copy is not constexpr before c++20.
+    for (size_t i = 0; i < name.size(); i++)
+      this->name[i] = name[i];
+  }
+
+  constexpr string_view name_view() const {
+    return {name, name_size};
+  }
+};
+
+#endif
+
 template <typename T, size_t N, typename ItemMeta>
 using EnumItems = array<EnumItem<T, ItemMeta>, N>;
 
@@ -763,7 +2164,7 @@ struct EnumInfo {
   using enum_t = T;
   using base_t = BASE;
 
-  string_view               name;
+  Name                      name;
   EnumItems<T, N, ItemMeta> items;
   size_t                    size;
   Meta                      meta;
@@ -781,7 +2182,7 @@ struct EnumInfo {
 
   static constexpr auto npos = -1;
 
-  constexpr int index_of_value(T v) {
+  constexpr int index_of_value(T v) const {
     auto i = 0;
     for (auto& e : items) {
       if (e.value == v) {
@@ -792,10 +2193,11 @@ struct EnumInfo {
     return npos;
   }
 
-  constexpr int index_of_name(string_view n) {
+  constexpr int index_of_name(string_view n) const {
+    Name key = n;
     auto i = 0;
     for (auto& e : items) {
-      if (e.name == n) {
+      if (e.name == key) {
         return i;
       }
       i++;
@@ -805,7 +2207,7 @@ struct EnumInfo {
 };
 
 template <typename T, typename BASE, int N, typename Meta, typename ItemMeta>
-constexpr auto makeEnumInfo(string_view                      name,
+constexpr auto makeEnumInfo(Name                             name,
                             const EnumItems<T, N, ItemMeta>& items,
                             Meta                             meta) {
   return EnumInfo<T, BASE, N, Meta, ItemMeta>{name, items, N, meta};
@@ -813,9 +2215,23 @@ constexpr auto makeEnumInfo(string_view                      name,
 
 void _tref_enum_info(void*);
 
+template <typename T, size_t N, typename ItemMeta>
+constexpr bool unique_item_hashes(const EnumItems<T, N, ItemMeta>& items) {
+  array<Name, N> names{};
+  for (size_t i = 0; i < N; i++)
+    names[i] = items[i].name_view();
+  return unique_name_hashes(names);
+}
+
 template <typename T, typename = enable_if_t<is_enum_v<T>>>
 constexpr auto enum_info() {
-  return _tref_enum_info((T**)0);
+  if constexpr (is_same_v<decltype(_tref_enum_info((T**)0)), void>) {
+    return;
+  } else {
+    constexpr auto info = _tref_enum_info((T**)0);
+    static_assert(unique_item_hashes(info.items), "two item names of the enum have the same hash");
+    return info;
+  }
 }
 
 template <typename T>
@@ -852,7 +2268,7 @@ constexpr bool each_enum(F f) {
 #define ZTrefEnumImpWithMeta(T, BASE, meta, ...)                                        \
   constexpr auto _tref_enum_info(ZTrefRemoveParen(T)**) {                               \
     return tref::imp::makeEnumInfo<ZTrefRemoveParen(T), BASE, ZTrefCount(__VA_ARGS__)>( \
-        ZTrefStringify(ZTrefRemoveParen(T)),                                            \
+        ZTrefName(ZTrefStringify(ZTrefRemoveParen(T))),                                 \
         std::array{ZTrefEnumStringize(T, __VA_ARGS__)},                                 \
         std::move(meta));                                                               \
   }
@@ -863,7 +2279,7 @@ constexpr bool each_enum(F f) {
 // (EnumValueConvertor)EnumType::EnumItem = EnumItemValue,
 #define ZTrefEnumStringizeSingle(P, E)                                         \
   tref::imp::EnumItem<ZTrefRemoveParen(P), std::nullptr_t>{                    \
-      tref::imp::enum_trim_name(#E),                                           \
+      ZTrefEnumItemName(#E),                                                   \
       (tref::imp::EnumValueConvertor)ZTrefRemoveParen(P)::ZTrefRemoveParen(E), \
       nullptr},
 
@@ -892,7 +2308,7 @@ constexpr bool each_enum(F f) {
   constexpr auto _tref_enum_info(ZTrefRemoveParen(T)**) {                  \
     return tref::imp::makeEnumInfo<ZTrefRemoveParen(T), BASE,              \
                                    ZTrefCount(__VA_ARGS__)>(               \
-        ZTrefStringify(ZTrefRemoveParen(T)),                               \
+        ZTrefName(ZTrefStringify(ZTrefRemoveParen(T))),                    \
         std::array{ZTrefEnumStringize2(T, __VA_ARGS__)}, std::move(meta)); \
   }
 
@@ -902,23 +2318,29 @@ constexpr bool each_enum(F f) {
 #define ZTrefEnumStringizeSingle2(P, E)                                       \
   tref::imp::EnumItem<ZTrefRemoveParen(P),                                    \
                       decltype(ZTrefRemoveParen(ZTrefSecondRemoveParen(E)))>{ \
-      tref::imp::enum_trim_name(ZTrefStringify(ZTrefFirstRemoveParen(E))),    \
+      ZTrefEnumItemName(ZTrefStringify(ZTrefFirstRemoveParen(E))),            \
       (tref::imp::EnumValueConvertor)ZTrefRemoveParen(P)::ZTrefRemoveParen(   \
           ZTrefFirstRemoveParen(E)),                                          \
       ZTrefRemoveParen(ZTrefSecondRemoveParen(E))},
 
 /////////////////////////////////////
 
-constexpr string_view enum_trim_name(string_view s) {
-  auto p = s.find_first_of('=');
-  if (p != string_view::npos)
-    p = s.rfind(' ', p);
-  return s.substr(0, p);
-}
+template <typename T>
+constexpr int enum_index(T v);
 
 template <typename T>
-constexpr string_view enum_to_string(T v) {
+constexpr int enum_index_of_name(string_view name);
+
+template <typename T>
+constexpr Name enum_to_string(T v) {
   static_assert(is_enum_v<T>);
+#if ZTrefCxx20
+  // The lookup tables are only instantiated for runtime calls.
+  if (!is_constant_evaluated()) {
+    auto i = enum_index(v);
+    return i < 0 ? Name{} : enum_info_v<T>.items[i].name;
+  }
+#endif
   for (auto& e : enum_info_v<T>.items) {
     if (e.value == v) {
       return e.name;
@@ -930,14 +2352,580 @@ constexpr string_view enum_to_string(T v) {
 template <typename T>
 constexpr T string_to_enum(string_view s, T default_) {
   static_assert(is_enum_v<T>);
+  Name key = s;
+#if ZTrefCxx20
+  if (!is_constant_evaluated()) {
+    auto i = enum_index_of_name<T>(s);
+    return i < 0 ? default_ : enum_info_v<T>.items[i].value;
+  }
+#endif
   for (auto& e : enum_info_v<T>.items) {
-    if (s == e.name) {
+    if (key == e.name) {
       return e.value;
     }
   }
   return default_;
 }
 
+/////////////////////////////////////
+// dense index of enum items
+
+template <typename T>
+constexpr size_t enum_count_v = tuple_size_v<decltype(enum_info_v<T>.items)>;
+
+// The underlying value: no truncation of unsigned 64-bit values.
+template <typename T>
+constexpr underlying_type_t<T> enum_value_of(T v) {
+  return static_cast<underlying_type_t<T>>(v);
+}
+
+template <typename T>
+constexpr auto enum_min_v = [] {
+  auto ret = enum_value_of(enum_info_v<T>.items[0].value);
+  for (auto& e : enum_info_v<T>.items)
+    ret = min(ret, enum_value_of(e.value));
+  return ret;
+}();
+
+template <typename T>
+constexpr auto enum_max_v = [] {
+  auto ret = enum_value_of(enum_info_v<T>.items[0].value);
+  for (auto& e : enum_info_v<T>.items)
+    ret = max(ret, enum_value_of(e.value));
+  return ret;
+}();
+
+// Values spanning a small range are indexed by a lookup table, sparse ones by
+// binary search over the sorted values.
+// Distance from the smallest value, computed in 64 bits to not overflow.
+template <typename T>
+constexpr uint64_t enum_offset_of(underlying_type_t<T> v) {
+  return uint64_t(v) - uint64_t(enum_min_v<T>);
+}
+
+template <typename T>
+constexpr bool enum_use_lut_v = enum_offset_of<T>(enum_max_v<T>) < max<size_t>(64, enum_count_v<T> * 4);
+
+template <typename T>
+constexpr auto enum_lut_v = [] {
+  constexpr size_t range = enum_use_lut_v<T> ? enum_offset_of<T>(enum_max_v<T>) + 1 : 1;
+
+  array<int16_t, range> ret{};
+  for (auto& i : ret)
+    i = -1;
+  if constexpr (enum_use_lut_v<T>) {
+    int16_t idx = 0;
+    for (auto& e : enum_info_v<T>.items) {
+      auto& slot = ret[enum_offset_of<T>(enum_value_of(e.value))];
+      if (slot < 0)
+        slot = idx;
+      idx++;
+    }
+  }
+  return ret;
+}();
+
+template <typename T>
+struct EnumSortedValue {
+  underlying_type_t<T> value;
+  int16_t              index;
+};
+
+template <typename T>
+constexpr auto enum_sorted_values_v = [] {
+  array<EnumSortedValue<T>, enum_count_v<T>> ret{};
+  int16_t                                    idx = 0;
+  for (auto& e : enum_info_v<T>.items) {
+    ret[idx] = {enum_value_of(e.value), idx};
+    idx++;
+  }
+  // insertion sort, stable to keep the first item of duplicated values.
+  for (size_t i = 1; i < ret.size(); i++) {
+    for (auto j = i; j > 0 && ret[j - 1].value > ret[j].value; j--) {
+      auto t = ret[j];
+      ret[j] = ret[j - 1];
+      ret[j - 1] = t;
+    }
+  }
+  return ret;
+}();
+
+// Get the dense index of an enum value in `EnumInfo::items`.
+// @return: -1 if the value is not an item.
+template <typename T>
+constexpr int enum_index(T v) {
+  static_assert(is_enum_v<T>);
+  auto val = enum_value_of(v);
+  if constexpr (enum_use_lut_v<T>) {
+    if (val < enum_min_v<T> || val > enum_max_v<T>)
+      return -1;
+    return enum_lut_v<T>[enum_offset_of<T>(val)];
+  } else {
+    auto&  sorted = enum_sorted_values_v<T>;
+    size_t lo = 0, hi = sorted.size();
+    while (lo < hi) {
+      auto mid = (lo + hi) / 2;
+      if (sorted[mid].value < val)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo < sorted.size() && sorted[lo].value == val ? sorted[lo].index : -1;
+  }
+}
+
+// Fixed-size map from enum items to values, indexed by `enum_index`.
+template <typename E, typename V>
+struct EnumMap {
+  using enum_t = E;
+  using value_t = V;
+
+  array<V, enum_count_v<E>> values{};
+
+  static constexpr size_t size() { return enum_count_v<E>; }
+
+  // NOTE: `e` must be an item of the enum.
+  constexpr V&       operator[](E e) { return values[enum_index(e)]; }
+  constexpr const V& operator[](E e) const { return values[enum_index(e)]; }
+
+  // @return: nullptr if `e` is not an item of the enum.
+  constexpr V* find(E e) {
+    auto i = enum_index(e);
+    return i < 0 ? nullptr : &values[i];
+  }
+  constexpr const V* find(E e) const {
+    auto i = enum_index(e);
+    return i < 0 ? nullptr : &values[i];
+  }
+
+  constexpr void fill(const V& v) {
+    for (auto& i : values)
+      i = v;
+  }
+
+  // @param f: [](auto& item, V& value) -> bool, return false to stop the
+  // iterating.
+  template <typename F>
+  constexpr bool each(F&& f) {
+    for (size_t i = 0; i < size(); i++) {
+      if (!f(enum_info_v<E>.items[i], values[i]))
+        return false;
+    }
+    return true;
+  }
+
+  template <typename F>
+  constexpr bool each(F&& f) const {
+    for (size_t i = 0; i < size(); i++) {
+      if (!f(enum_info_v<E>.items[i], values[i]))
+        return false;
+    }
+    return true;
+  }
+};
+
+// Fixed-size bit set of enum items, indexed by `enum_index`.
+template <typename E>
+struct EnumSet {
+  using enum_t = E;
+
+  array<uint64_t, (enum_count_v<E> + 63) / 64> bits{};
+
+  static constexpr size_t capacity() { return enum_count_v<E>; }
+
+  // @return: false if `e` is not an item of the enum.
+  constexpr bool insert(E e) {
+    auto i = enum_index(e);
+    if (i < 0)
+      return false;
+    bits[i / 64] |= uint64_t(1) << (i % 64);
+    return true;
+  }
+
+  constexpr void erase(E e) {
+    auto i = enum_index(e);
+    if (i >= 0)
+      bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+  }
+
+  constexpr bool contains(E e) const {
+    auto i = enum_index(e);
+    return i >= 0 && (bits[i / 64] >> (i % 64)) & 1;
+  }
+
+  constexpr size_t size() const {
+    size_t ret = 0;
+    for (auto w : bits) {
+      for (; w; w &= w - 1)
+        ret++;
+    }
+    return ret;
+  }
+
+  constexpr bool empty() const {
+    for (auto w : bits) {
+      if (w)
+        return false;
+    }
+    return true;
+  }
+
+  constexpr void clear() {
+    for (auto& w : bits)
+      w = 0;
+  }
+
+  // Iterate the contained items in the order of `EnumInfo::items`.
+  // @param f: [](auto& item) -> bool, return false to stop the iterating.
+  template <typename F>
+  constexpr bool each(F&& f) const {
+    for (size_t i = 0; i < capacity(); i++) {
+      if ((bits[i / 64] >> (i % 64)) & 1)
+        if (!f(enum_info_v<E>.items[i]))
+          return false;
+    }
+    return true;
+  }
+};
+
+// Compact copy of the item metas indexed by `enum_index`.
+template <typename T>
+constexpr auto enum_meta_table_v = [] {
+  using Meta = decltype(enum_info_v<T>.items[0].meta);
+
+  array<Meta, enum_count_v<T>> ret{};
+  for (size_t i = 0; i < ret.size(); i++)
+    ret[i] = enum_info_v<T>.items[i].meta;
+  return ret;
+}();
+
+// Call the function stored as meta of the item `v` through a jump table,
+// with (v, args...) if it accepts them, otherwise with (args...).
+// NOTE: `v` must be an item of the enum.
+template <typename T, typename... Args>
+constexpr decltype(auto) enum_dispatch(T v, Args&&... args) {
+  auto fn = enum_meta_table_v<T>[enum_index(v)];
+  if constexpr (is_invocable_v<decltype(fn), T, Args&&...>) {
+    return fn(v, std::forward<Args>(args)...);
+  } else {
+    return fn(std::forward<Args>(args)...);
+  }
+}
+
+/////////////////////////////////////
+// enum flags
+
+constexpr int popcount64(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(v);
+#else
+  int n = 0;
+  for (; v; v &= v - 1)
+    n++;
+  return n;
+#endif
+}
+
+constexpr int countr_zero64(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  for (; !(v & 1); v >>= 1)
+    n++;
+  return n;
+#endif
+}
+
+void _tref_enum_flags(void*);
+
+template <typename T>
+constexpr auto is_enum_flags_v = !std::is_same_v<decltype(_tref_enum_flags((T**)0)), void>;
+
+template <typename T>
+constexpr uint64_t flags_bits(T v) {
+  return static_cast<uint64_t>(static_cast<make_unsigned_t<underlying_type_t<T>>>(v));
+}
+
+// Item index of each single bit flag, -1 for bits without an item.
+template <typename T>
+constexpr auto flags_bit_items_v = [] {
+  array<int16_t, 64> ret{};
+  for (auto& i : ret)
+    i = -1;
+  int16_t idx = 0;
+  for (auto& e : enum_info_v<T>.items) {
+    auto bits = flags_bits(e.value);
+    if (popcount64(bits) == 1 && ret[countr_zero64(bits)] < 0)
+      ret[countr_zero64(bits)] = idx;
+    idx++;
+  }
+  return ret;
+}();
+
+template <typename T>
+struct EnumSortedName {
+  Name    name;
+  int16_t index;
+};
+
+// Item names in lexicographical order (by hash with TrefHashNames), for
+// binary searching.
+template <typename T>
+constexpr auto enum_sorted_names_v = [] {
+  array<EnumSortedName<T>, enum_count_v<T>> ret{};
+  int16_t                                   idx = 0;
+  for (auto& e : enum_info_v<T>.items) {
+    ret[idx] = {e.name, idx};
+    idx++;
+  }
+  for (size_t i = 1; i < ret.size(); i++) {
+    for (auto j = i; j > 0 && ret[j].name < ret[j - 1].name; j--) {
+      auto t = ret[j];
+      ret[j] = ret[j - 1];
+      ret[j - 1] = t;
+    }
+  }
+  return ret;
+}();
+
+// @return: -1 if not found.
+template <typename T>
+constexpr int enum_index_of_name(string_view name) {
+  Name   key = name;
+  auto&  sorted = enum_sorted_names_v<T>;
+  size_t lo = 0, hi = sorted.size();
+  while (lo < hi) {
+    auto mid = (lo + hi) / 2;
+    if (sorted[mid].name < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < sorted.size() && sorted[lo].name == key ? sorted[lo].index : -1;
+}
+
+// Iterate the items of the single bit flags set in `v`.
+// @param f: [](auto& item) -> bool, return false to stop the iterating.
+template <typename T, typename F>
+constexpr bool each_flag(T v, F&& f) {
+  static_assert(is_enum_flags_v<T>, "use TrefEnumFlags to enable flags mode");
+  for (auto bits = flags_bits(v); bits; bits &= bits - 1) {
+    auto idx = flags_bit_items_v<T>[countr_zero64(bits)];
+    if (idx >= 0 && !f(enum_info_v<T>.items[idx]))
+      return false;
+  }
+  return true;
+}
+
+// Call `append(part)` for each part of the formatted flags.
+template <typename T, typename F>
+constexpr void format_flags(T v, F&& append) {
+  auto bits = flags_bits(v);
+  auto idx = enum_index(v);
+  if (idx >= 0) {
+    // exact item, including combined ones and zero.
+    append(string_view(enum_info_v<T>.items[idx].name_view()));
+    return;
+  }
+
+  uint64_t unknown = 0;
+  for (; bits; bits &= bits - 1) {
+    auto i = flags_bit_items_v<T>[countr_zero64(bits)];
+    if (i >= 0)
+      append(string_view(enum_info_v<T>.items[i].name_view()));
+    else
+      unknown |= bits & (~bits + 1);
+  }
+  if (unknown) {
+    char hex[19]{'0', 'x'};
+    auto n = 2;
+    for (int shift = 60; shift >= 0; shift -= 4) {
+      auto d = (unknown >> shift) & 0xf;
+      if (d || n > 2)
+        hex[n++] = "0123456789abcdef"[d];
+    }
+    append(string_view{hex, (size_t)n});
+  }
+}
+
+// Format flags as `A|B|0x40` into `buf`, bits without an item are appended
+// as one hex number.
+// @return: the formatted string, or an empty one with a null data() if it
+// does not fit in `buf`.
+template <typename T>
+constexpr string_view flags_to_string(T v, char* buf, size_t cap, char sep = '|') {
+  static_assert(is_enum_flags_v<T>, "use TrefEnumFlags to enable flags mode");
+  size_t len = 0;
+  bool   fits = true;
+  format_flags(v, [&](string_view s) {
+    if (len + (len ? 1 : 0) + s.size() > cap) {
+      fits = false;
+      return;
+    }
+    if (len)
+      buf[len++] = sep;
+    for (auto c : s)
+      buf[len++] = c;
+  });
+  return fits ? string_view{buf, len} : string_view{};
+}
+
+template <typename T>
+std::string flags_to_string(T v, char sep = '|') {
+  static_assert(is_enum_flags_v<T>, "use TrefEnumFlags to enable flags mode");
+  std::string ret;
+  format_flags(v, [&](string_view s) {
+    if (!ret.empty())
+      ret += sep;
+    ret.append(s);
+  });
+  return ret;
+}
+
+constexpr string_view flags_trim(string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    s.remove_suffix(1);
+  return s;
+}
+
+// Parse flags like `A | B|0x40`, each part is an item name or a number.
+// @return: `default_` if any part is invalid.
+template <typename T>
+constexpr T string_to_flags(string_view s, T default_, char sep = '|') {
+  static_assert(is_enum_flags_v<T>, "use TrefEnumFlags to enable flags mode");
+  uint64_t bits = 0;
+  while (true) {
+    auto p = s.find(sep);
+    auto part = flags_trim(s.substr(0, p));
+    if (part.empty())
+      return default_;
+
+    auto idx = enum_index_of_name<T>(part);
+    if (idx >= 0) {
+      bits |= flags_bits(enum_info_v<T>.items[idx].value);
+    } else {
+      uint64_t num = 0;
+      auto     base = 10;
+      if (part.size() > 2 && part[0] == '0' && (part[1] == 'x' || part[1] == 'X')) {
+        base = 16;
+        part.remove_prefix(2);
+      }
+      for (auto c : part) {
+        int d = c >= '0' && c <= '9'   ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                       : 99;
+        if (d >= base || num > (~uint64_t(0) - d) / base)
+          return default_;
+        num = num * base + d;
+      }
+      // must fit in the underlying type.
+      if (num > flags_bits(static_cast<T>(~make_unsigned_t<underlying_type_t<T>>(0))))
+        return default_;
+      bits |= num;
+    }
+
+    if (p == string_view::npos)
+      break;
+    s.remove_prefix(p + 1);
+  }
+  return static_cast<T>(bits);
+}
+
+// Enable flags mode: bitwise operators and flags_to_string/string_to_flags.
+#define ZTrefEnumFlagsImp(T, prefix)                                           \
+  prefix constexpr bool _tref_enum_flags(ZTrefRemoveParen(T)**) {              \
+    return true;                                                               \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T) operator|(ZTrefRemoveParen(T) a,        \
+                                                 ZTrefRemoveParen(T) b) {      \
+    using U = std::underlying_type_t<ZTrefRemoveParen(T)>;                     \
+    return static_cast<ZTrefRemoveParen(T)>(static_cast<U>(a) |                \
+                                            static_cast<U>(b));                \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T) operator&(ZTrefRemoveParen(T) a,        \
+                                                 ZTrefRemoveParen(T) b) {      \
+    using U = std::underlying_type_t<ZTrefRemoveParen(T)>;                     \
+    return static_cast<ZTrefRemoveParen(T)>(static_cast<U>(a) &                \
+                                            static_cast<U>(b));                \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T) operator^(ZTrefRemoveParen(T) a,        \
+                                                 ZTrefRemoveParen(T) b) {      \
+    using U = std::underlying_type_t<ZTrefRemoveParen(T)>;                     \
+    return static_cast<ZTrefRemoveParen(T)>(static_cast<U>(a) ^                \
+                                            static_cast<U>(b));                \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T) operator~(ZTrefRemoveParen(T) a) {      \
+    using U = std::underlying_type_t<ZTrefRemoveParen(T)>;                     \
+    return static_cast<ZTrefRemoveParen(T)>(static_cast<U>(~static_cast<U>(a))); \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T)& operator|=(ZTrefRemoveParen(T)& a,     \
+                                                   ZTrefRemoveParen(T) b) {    \
+    return a = a | b;                                                          \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T)& operator&=(ZTrefRemoveParen(T)& a,     \
+                                                   ZTrefRemoveParen(T) b) {    \
+    return a = a & b;                                                          \
+  }                                                                            \
+  prefix constexpr ZTrefRemoveParen(T)& operator^=(ZTrefRemoveParen(T)& a,     \
+                                                   ZTrefRemoveParen(T) b) {    \
+    return a = a ^ b;                                                          \
+  }
+
+// Use it out of class, after the enum is reflected.
+#define ZTrefEnumFlags(T) ZTrefEnumFlagsImp(T, )
+
+// Use it inside of class, after the enum is reflected.
+#define ZTrefMemberEnumFlags(T) ZTrefEnumFlagsImp(T, friend)
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// sidecar name table
+///
+//////////////////////////////////////////////////////////////////////////
+
+#if !TrefHashNames
+
+inline void append_name_line(string& out, string_view name) {
+  auto h = name_hash(name);
+  for (int shift = 28; shift >= 0; shift -= 4)
+    out += "0123456789abcdef"[(h >> shift) & 0xf];
+  out.append(" ").append(name).append("\n");
+}
+
+template <typename C>
+void append_class_names(string& out) {
+  append_name_line(out, class_info_v<C>.name);
+  tuple_for_each(class_fields_v<C>, [&](const auto& f) {
+    append_name_line(out, f.name);
+    return true;
+  });
+}
+
+// Append the `hash name` lines of an enum and its items, or of a class, its
+// fields and its subclasses, to be loaded by load_name_table in the builds
+// with TrefHashNames.
+// NOTE: must call this function in a template function.
+template <typename T>
+void append_name_table(string& out) {
+  if constexpr (is_enum_v<T>) {
+    append_name_line(out, enum_info_v<T>.name);
+    for (auto& e : enum_info_v<T>.items)
+      append_name_line(out, e.name_view());
+  } else {
+    append_class_names<T>(out);
+    class_info<T>().each_subclass([&](auto info, int) {
+      append_class_names<typename decltype(info)::class_t>(out);
+      return true;
+    });
+  }
+}
+
+#endif
+
 }  // namespace imp
 
 //////////////////////////////////////////////////////////////////////////
@@ -949,34 +2937,77 @@ constexpr T string_to_enum(string_view s, T default_) {
 #define TrefHasTref ZTrefHasTref
 #define TrefVersion ZTrefVersion
 
+#if TrefHashNames
+using imp::HashedName;
+using imp::load_name_table;
+#else
+using imp::append_name_table;
+#endif
+
+using imp::assert_no_cacheline_split;
+using imp::call_hooked;
 using imp::class_fields_v;
 using imp::class_info;
 using imp::class_info_t;
 using imp::class_info_v;
+using imp::clone;
+using imp::clone_move;
+using imp::is_clonable_v;
+using imp::convert;
+using imp::convert_into;
+using imp::copy_runs_v;
 using imp::ClassInfo;
+using imp::compile_path;
+using imp::CompiledPath;
 using imp::create_subclass;
 using imp::each_field;
 using imp::each_subclass;
 using imp::enclosing_class_t;
 using imp::enum_info_v;
+using imp::field_offset;
 using imp::FieldInfo;
+using imp::FieldLayout;
 using imp::func_trait;
+using imp::get_subclass_id;
 using imp::has_base_class_v;
+using imp::has_constexpr_layout_v;
+using imp::hook_chain_v;
+using imp::HookChain;
 using imp::is_reflected_v;
+using imp::layout_report;
+using imp::layout_stats_of;
+using imp::layout_stats_v;
+using imp::layout_v;
+using imp::LayoutKind;
+using imp::LayoutStats;
 using imp::member_t;
+using imp::MetaConvertStrict;
+using imp::Name;
+using imp::name_hash;
+using imp::MetaHookable;
+using imp::MetaHookableBase;
 using imp::Metas;
 using imp::overload_v;
+using imp::packed_layout_v;
+using imp::packed_size_v;
+using imp::padding_bytes_v;
 using imp::subclass_id;
 using imp::tuple_convert;
 using imp::tuple_for_each;
+using imp::type_id;
+using imp::visit;
 
 #define TrefType ZTrefType
 #define TrefTypeWithMeta ZTrefTypeWithMeta
 #define TrefSubType ZTrefSubType
+#define TrefSubTypes ZTrefSubTypes
+#define TrefSubclassId ZTrefSubclassId
 #define TrefBaseOf ZTrefBaseOf
 
 #define TrefField ZTrefField
+#define TrefFields ZTrefFields
 #define TrefFieldWithMeta ZTrefFieldWithMeta
+#define TrefHookable ZTrefHookable
 #define TrefMemberType ZTrefMemberType
 #define TrefMemberTypeWithMeta ZTrefMemberTypeWithMeta
 
@@ -994,13 +3025,28 @@ using imp::tuple_for_each;
 /// enum
 
 using imp::each_enum;
+using imp::each_flag;
+using imp::enum_count_v;
+using imp::enum_dispatch;
+using imp::enum_index;
 using imp::enum_info;
 using imp::enum_info_t;
 using imp::enum_to_string;
 using imp::EnumInfo;
 using imp::EnumItem;
+using imp::EnumMap;
+using imp::EnumSet;
+using imp::flags_to_string;
+using imp::is_enum_flags_v;
 using imp::is_reflected_enum_v;
 using imp::string_to_enum;
+using imp::string_to_flags;
+
+template <typename E, typename V>
+using enum_map = imp::EnumMap<E, V>;
+
+template <typename E>
+using enum_set = imp::EnumSet<E>;
 
 // ex version support meta for enum items.
 
@@ -1017,6 +3063,8 @@ using imp::string_to_enum;
 #define TrefExternalEnumWithMeta ZTrefEnumImpWithMeta
 #define TrefExternalEnumWithMetaEx ZTrefEnumImpWithMetaEx
 #define TrefEnumRegister ZTrefEnumRegister
+#define TrefEnumFlags ZTrefEnumFlags
+#define TrefMemberEnumFlags ZTrefMemberEnumFlags
 
 }  // namespace tref
 
@@ -0,0 +1,869 @@
+// Runtime benchmarks of Tref.
+// Build: g++ -std=c++17 -O2 TrefBench.cpp -o TrefBench -pthread
+// Run:   TrefBench [--json | --csv] [--filter=name]
+//
+// Every measurement is recorded as ns/op with percentiles over the sampled
+// batches. --json & --csv print the records to stdout to compare them
+// between commits, the human readable lines go to stderr then.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Tref.hpp"
+#include "TrefData.hpp"
+#include "TrefRpc.hpp"
+#include "TrefRuntime.hpp"
+
+using namespace std;
+using namespace tref;
+using namespace std::literals;
+
+//////////////////////////////////////////////////////////////////////////
+// helpers
+
+FILE* benchLog = stdout;
+#define ZBenchPrint(...) fprintf(benchLog, __VA_ARGS__)
+
+struct BenchRecord {
+  string name;
+  int    samples = 0;
+  double mean = 0, min = 0, p50 = 0, p90 = 0, p99 = 0;
+};
+
+vector<BenchRecord> benchRecords;
+
+constexpr auto benchSamples = 41;
+
+// Run f(i) for i in [0, iterations) split into batches, the percentiles are
+// taken over the ns/op of the batches.
+// @return: mean ns/op.
+template <typename F>
+double measureNs(string name, int iterations, F&& f) {
+  auto           batches = min(iterations, benchSamples);
+  auto           batch = iterations / batches;
+  vector<double> samples;
+  double         total = 0;
+  for (int b = 0, i = 0; b < batches; b++) {
+    auto start = chrono::steady_clock::now();
+    for (int k = 0; k < batch; k++, i++)
+      f(i);
+    auto ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    total += ns;
+    samples.push_back(ns / batch);
+  }
+
+  sort(samples.begin(), samples.end());
+  auto at = [&](double p) { return samples[min(samples.size() - 1, size_t(p * samples.size()))]; };
+  benchRecords.push_back(
+      {move(name), batches, total / (batches * batch), samples[0], at(0.5), at(0.9), at(0.99)});
+  return benchRecords.back().mean;
+}
+
+void printRecords(string_view format) {
+  if (format == "csv") {
+    printf("name,samples,mean_ns,min_ns,p50_ns,p90_ns,p99_ns\n");
+    for (auto& r : benchRecords)
+      printf("%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f\n", r.name.c_str(), r.samples, r.mean, r.min, r.p50,
+             r.p90, r.p99);
+  } else if (format == "json") {
+    printf("[\n");
+    for (size_t i = 0; i < benchRecords.size(); i++) {
+      auto& r = benchRecords[i];
+      printf(
+          "  {\"name\": \"%s\", \"samples\": %d, \"mean_ns\": %.3f, \"min_ns\": %.3f, \"p50_ns\": %.3f, "
+          "\"p90_ns\": %.3f, \"p99_ns\": %.3f}%s\n",
+          r.name.c_str(), r.samples, r.mean, r.min, r.p50, r.p90, r.p99,
+          i + 1 < benchRecords.size() ? "," : "");
+    }
+    printf("]\n");
+  }
+}
+
+#define ZBenchNoInline __attribute__((noinline))
+
+template <typename T>
+void doNotOptimize(T&& v) {
+  asm volatile("" : : "g"(&v) : "memory");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// visit vs dynamic_cast vs virtual call
+
+template <int N>
+struct VisitRoot {
+  TrefType(VisitRoot);
+  TrefSubclassId(VisitRoot);
+
+  virtual ~VisitRoot() = default;
+  virtual int op() const { return 0; }
+
+  int val = 1;
+};
+
+template <typename Root, int I>
+struct VisitSub : Root {
+  TrefType(VisitSub);
+  TrefSubclassId(Root);
+
+  int op() const override { return this->val + I; }
+};
+
+#define ZBenchSub(R, I) TrefSubType((VisitSub<R, I>));
+#define ZBenchSub10(R, n)                                                  \
+  ZBenchSub(R, n * 10 + 0) ZBenchSub(R, n * 10 + 1) ZBenchSub(R, n * 10 + 2) \
+  ZBenchSub(R, n * 10 + 3) ZBenchSub(R, n * 10 + 4) ZBenchSub(R, n * 10 + 5) \
+  ZBenchSub(R, n * 10 + 6) ZBenchSub(R, n * 10 + 7) ZBenchSub(R, n * 10 + 8) \
+  ZBenchSub(R, n * 10 + 9)
+#define ZBenchSub50(R, n)                                                   \
+  ZBenchSub10(R, n * 5 + 0) ZBenchSub10(R, n * 5 + 1) ZBenchSub10(R, n * 5 + 2) \
+  ZBenchSub10(R, n * 5 + 3) ZBenchSub10(R, n * 5 + 4)
+
+using VisitRoot10 = VisitRoot<10>;
+using VisitRoot50 = VisitRoot<50>;
+using VisitRoot200 = VisitRoot<200>;
+
+ZBenchSub10(VisitRoot10, 0);
+ZBenchSub50(VisitRoot50, 0);
+ZBenchSub50(VisitRoot200, 0);
+ZBenchSub50(VisitRoot200, 1);
+ZBenchSub50(VisitRoot200, 2);
+ZBenchSub50(VisitRoot200, 3);
+
+template <typename Root, int... I>
+int dynamicCastChain(const Root* p, integer_sequence<int, I...>) {
+  int ret = 0;
+  ((dynamic_cast<const VisitSub<Root, I>*>(p) ? (ret = p->val + I, true) : false) || ...);
+  return ret;
+}
+
+template <typename Root, int N>
+void benchVisit() {
+  constexpr auto iterations = 1000000;
+
+  vector<unique_ptr<Root>> objs;
+  mt19937                  rng(N);
+  for (int i = 0; i < 1024; i++) {
+    Root* p = create_subclass<Root>(rng() % N);
+    objs.emplace_back(p);
+  }
+
+  auto visitNs = measureNs("visit/tref_visit/" + to_string(N), iterations, [&](int i) {
+    auto r = tref::visit(objs[i & 1023].get(), [](auto& o) {
+      using S = std::decay_t<decltype(o)>;
+      if constexpr (is_same_v<S, Root>)
+        return 0;
+      else
+        return o.S::op();
+    });
+    doNotOptimize(r);
+  });
+
+  auto virtualNs = measureNs("visit/virtual/" + to_string(N), iterations, [&](int i) {
+    auto r = objs[i & 1023]->op();
+    doNotOptimize(r);
+  });
+
+  auto dynamicCastNs = measureNs("visit/dynamic_cast/" + to_string(N), iterations / 10, [&](int i) {
+    auto r = dynamicCastChain(objs[i & 1023].get(), make_integer_sequence<int, N>());
+    doNotOptimize(r);
+  });
+
+  ZBenchPrint("visit %3d subclasses: tref::visit %6.2f ns, virtual %6.2f ns, dynamic_cast chain %8.2f ns\n",
+              N, visitNs, virtualNs, dynamicCastNs);
+}
+
+template <typename = void>
+void benchVisitAll() {
+  benchVisit<VisitRoot10, 10>();
+  benchVisit<VisitRoot50, 50>();
+  benchVisit<VisitRoot200, 200>();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// tref::clone vs virtual clone()
+
+struct ClonePrefab {
+  TrefType(ClonePrefab);
+  TrefSubclassId(ClonePrefab);
+
+  virtual ~ClonePrefab() = default;
+  virtual ClonePrefab* clone() const { return new ClonePrefab(*this); }
+
+  string name = "prefab";
+  float  transform[16] = {};
+};
+
+template <int I>
+struct ClonePrefabSub : ClonePrefab {
+  TrefType(ClonePrefabSub);
+  TrefSubclassId(ClonePrefab);
+
+  ClonePrefab* clone() const override { return new ClonePrefabSub(*this); }
+
+  int payload[I + 1] = {};
+};
+
+#define ZBenchCloneSub(I) TrefSubType(ClonePrefabSub<I>);
+ZBenchCloneSub(0) ZBenchCloneSub(1) ZBenchCloneSub(2) ZBenchCloneSub(3) ZBenchCloneSub(4)
+ZBenchCloneSub(5) ZBenchCloneSub(6) ZBenchCloneSub(7) ZBenchCloneSub(8) ZBenchCloneSub(9)
+
+template <typename = void>
+void benchClone() {
+  constexpr auto iterations = 1000000;
+
+  vector<unique_ptr<ClonePrefab>> objs;
+  mt19937                         rng(10);
+  for (int i = 0; i < 1024; i++)
+    objs.emplace_back(create_subclass<ClonePrefab>(rng() % 10));
+
+  auto virtualNs = measureNs("clone/virtual", iterations, [&](int i) {
+    auto p = objs[i & 1023]->clone();
+    doNotOptimize(p);
+    delete p;
+  });
+
+  auto trefNs = measureNs("clone/tref", iterations, [&](int i) {
+    auto p = tref::clone<ClonePrefab>(objs[i & 1023].get());
+    doNotOptimize(p);
+    delete p;
+  });
+
+  // bump allocator, reset every 1024 clones.
+  vector<char> arena(1024 * 256);
+  size_t       used = 0;
+  auto         alloc = [&](size_t size, size_t align) -> void* {
+    used = (used + align - 1) / align * align;
+    auto p = arena.data() + used;
+    used += size;
+    return p;
+  };
+  auto arenaNs = measureNs("clone/tref_arena", iterations, [&](int i) {
+    if ((i & 1023) == 0)
+      used = 0;
+    auto p = tref::clone<ClonePrefab>(objs[i & 1023].get(), alloc);
+    doNotOptimize(p);
+    p->~ClonePrefab();
+  });
+
+  ZBenchPrint("clone 10 subclasses: virtual clone() %6.2f ns, tref::clone %6.2f ns, tref::clone arena %6.2f ns\n",
+              virtualNs, trefNs, arenaNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// enum_dispatch vs linear index_of_value
+
+enum class BenchOp;
+int benchOpAdd(int a, int b) {
+  return a + b;
+}
+int benchOpSub(int a, int b) {
+  return a - b;
+}
+int benchOpMul(int a, int b) {
+  return a * b;
+}
+int benchOpDiv(int a, int b) {
+  return b ? a / b : 0;
+}
+
+TrefEnumEx(BenchOp, int, (Add = 1, &benchOpAdd), (Sub = 3, &benchOpSub), (Mul = 5, &benchOpMul), (Div = 7, &benchOpDiv));
+
+void benchEnumDispatch() {
+  constexpr auto iterations = 10000000;
+
+  vector<BenchOp> ops;
+  mt19937         rng(0);
+  for (int i = 0; i < 1024; i++)
+    ops.push_back(enum_info_v<BenchOp>.items[rng() % 4].value);
+
+  auto dispatchNs = measureNs("enum_dispatch/enum_dispatch", iterations, [&](int i) {
+    auto r = enum_dispatch(ops[i & 1023], i, 3);
+    doNotOptimize(r);
+  });
+
+  auto linearNs = measureNs("enum_dispatch/index_of_value", iterations, [&](int i) {
+    auto op = ops[i & 1023];
+    auto r = enum_info_v<BenchOp>.items[enum_info_v<BenchOp>.index_of_value(op)].meta(i, 3);
+    doNotOptimize(r);
+  });
+
+  ZBenchPrint("enum dispatch: enum_dispatch %6.2f ns, index_of_value %6.2f ns\n", dispatchNs, linearNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// csv loading throughput
+
+struct BenchRow {
+  TrefType(BenchRow);
+
+  int     id = 0;
+  double  price = 0;
+  int64_t stamp = 0;
+  BenchOp op = BenchOp::Add;
+  string  name;
+  TrefField(id);
+  TrefField(price);
+  TrefField(stamp);
+  TrefField(op);
+  TrefField(name);
+};
+
+void benchCsv() {
+  string csv = "id,price,stamp,op,name\n";
+  mt19937 rng(0);
+  while (csv.size() < (64 << 20)) {
+    csv += to_string(rng() % 100000) + "," + to_string((rng() % 100000) / 100.0) + "," +
+           to_string(1600000000000ll + rng()) + "," +
+           string(enum_to_string(enum_info_v<BenchOp>.items[rng() % 4].value)) + ",item" +
+           to_string(rng() % 1000) + "\n";
+  }
+
+  for (auto threads : {1u, 0u}) {
+    vector<BenchRow> rows;
+    auto             ns = measureNs("csv_load/threads/" + to_string(threads), 1,
+                                    [&](int) { load_csv(csv, rows, {',', threads}); });
+    ZBenchPrint("csv load %u threads: %zu rows, %7.1f MB/s\n",
+                threads ? threads : thread::hardware_concurrency(), rows.size(),
+                csv.size() / (ns / 1e9) / (1 << 20));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// rpc router loopback: encode batch -> dispatch -> decode results
+
+struct BenchRpcExport {};
+
+struct BenchService {
+  TrefType(BenchService);
+
+  int64_t total = 0;
+
+  int64_t add(int32_t a, int32_t b) { return total += a + b; }
+  TrefFieldWithMeta(add, BenchRpcExport{});
+
+  void setOp(BenchOp op) { total ^= (int)op; }
+  TrefFieldWithMeta(setOp, BenchRpcExport{});
+};
+
+using BenchRouter = RpcRouter<BenchService, BenchRpcExport>;
+
+void benchRpc() {
+  constexpr auto totalCalls = 4 << 20;
+
+  BenchService svc;
+  string       calls, results;
+  for (auto batch : {1, 16, 256}) {
+    auto ns = measureNs("rpc_loopback/batch/" + to_string(batch), totalCalls / batch, [&](int i) {
+      calls.clear();
+      results.clear();
+      ByteWriter w(calls), rw(results);
+      for (int k = 0; k < batch; k++) {
+        if (k & 7)
+          BenchRouter::encode_call<&BenchService::add>(w, i, k);
+        else
+          BenchRouter::encode_call<&BenchService::setOp>(w, BenchOp::Sub);
+      }
+      BenchRouter::dispatch(svc, calls, rw);
+
+      ByteReader r(results);
+      int64_t    v = 0;
+      for (int k = 0; k < batch; k++) {
+        if (k & 7)
+          BenchRouter::decode_result(r, v);
+        else
+          BenchRouter::decode_result(r);
+      }
+      doNotOptimize(v);
+    });
+    ZBenchPrint("rpc loopback %3d calls/batch: %6.2f ns/call, %6.2f M calls/s\n", batch, ns / batch,
+                batch * 1e3 / ns);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// hook chain vs nested std::function
+
+struct BenchUnit {
+  TrefType(BenchUnit);
+
+  int hp = 0;
+
+  ZBenchNoInline int damage(int v) { return hp -= v; }
+  TrefHookable(damage);
+};
+
+void benchHooks() {
+  constexpr auto iterations = 20000000;
+
+  BenchUnit u;
+  auto      directNs = measureNs("hooks/direct", iterations, [&](int i) { doNotOptimize(u.damage(i & 7)); });
+  auto      emptyNs = measureNs("hooks/no_hooks", iterations, [&](int i) {
+    doNotOptimize(call_hooked<&BenchUnit::damage>(u, i & 7));
+  });
+
+  int  counter = 0;
+  auto pre = [](void* ctx, BenchUnit&, int&) { ++*(int*)ctx; };
+  hook_chain_v<&BenchUnit::damage>.add(pre, nullptr, &counter);
+  hook_chain_v<&BenchUnit::damage>.add(pre, nullptr, &counter);
+  auto hookedNs = measureNs("hooks/2_hooks", iterations, [&](int i) {
+    doNotOptimize(call_hooked<&BenchUnit::damage>(u, i & 7));
+  });
+  hook_chain_v<&BenchUnit::damage>.clear();
+
+  function<int(BenchUnit&, int)> f = [](BenchUnit& self, int v) { return self.damage(v); };
+  for (int i = 0; i < 2; i++) {
+    f = [ff = move(f), &counter](BenchUnit& self, int v) {
+      ++counter;
+      return ff(self, v);
+    };
+  }
+  doNotOptimize(f);
+  auto functionNs =
+      measureNs("hooks/2_std_function", iterations, [&](int i) { doNotOptimize(f(u, i & 7)); });
+
+  ZBenchPrint("hooks: direct %5.2f ns, no hooks %5.2f ns, 2 hooks %5.2f ns, 2 std::function layers %5.2f ns\n",
+              directNs, emptyNs, hookedNs, functionNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// compiled property path vs resolving names on each access
+
+struct BenchVec {
+  TrefType(BenchVec);
+
+  float x = 0, y = 0, z = 0;
+  TrefField(x);
+  TrefField(y);
+  TrefField(z);
+};
+
+struct BenchTransform {
+  TrefType(BenchTransform);
+
+  BenchVec pos, rot, scale;
+  TrefField(pos);
+  TrefField(rot);
+  TrefField(scale);
+};
+
+struct BenchItem {
+  TrefType(BenchItem);
+
+  int id = 0, count = 0;
+  TrefField(id);
+  TrefField(count);
+};
+
+struct BenchEntity {
+  TrefType(BenchEntity);
+
+  int               id = 0;
+  string            name;
+  BenchTransform    transform;
+  vector<BenchItem> items = vector<BenchItem>(8);
+  TrefField(id);
+  TrefField(name);
+  TrefField(transform);
+  TrefField(items);
+};
+
+void benchPath() {
+  constexpr auto iterations = 2000000;
+
+  BenchEntity e;
+  for (auto path : {"transform.scale.z"sv, "items[3].count"sv}) {
+    auto compiled = compile_path<BenchEntity>(path);
+    auto onceNs = measureNs("path/compiled/" + string(path), iterations,
+                            [&](int) { doNotOptimize(compiled.resolve(e)); });
+    auto eachNs = measureNs("path/resolve_each/" + string(path), iterations, [&](int) {
+      doNotOptimize(compile_path<BenchEntity>(path).resolve(e));
+    });
+    ZBenchPrint("path %-18s: compiled once %6.2f ns, resolved each access %7.2f ns\n", path.data(),
+                onceNs, eachNs);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// enum names
+
+TrefEnum(BenchEnum4, int, A0, A1, A2, A3);
+TrefEnum(BenchEnum16, int, B0, B1, B2, B3, B4, B5, B6, B7, B8, B9, B10, B11, B12, B13, B14, B15);
+TrefEnum(BenchEnum30, int, C0, C1, C2, C3, C4, C5, C6, C7, C8, C9, C10, C11, C12, C13, C14, C15, C16,
+         C17, C18, C19, C20, C21, C22, C23, C24, C25, C26, C27, C28, C29);
+
+template <typename E>
+void benchEnumNames() {
+  constexpr auto iterations = 4000000;
+  constexpr auto& items = enum_info_v<E>.items;
+  constexpr auto  n = items.size();
+
+  vector<E>           values;
+  vector<string_view> names;
+  mt19937             rng(0);
+  for (int i = 0; i < 1024; i++) {
+    values.push_back(items[rng() % n].value);
+    names.push_back(enum_to_string(values.back()));
+  }
+
+  auto toNs = measureNs("enum_to_string/" + to_string(n), iterations,
+                        [&](int i) { doNotOptimize(enum_to_string(values[i & 1023])); });
+  auto fromNs = measureNs("string_to_enum/" + to_string(n), iterations,
+                          [&](int i) { doNotOptimize(string_to_enum(names[i & 1023], items[0].value)); });
+  ZBenchPrint("enum %2zu items: enum_to_string %6.2f ns, string_to_enum %6.2f ns\n", n, toNs, fromNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// create_subclass
+
+template <typename Root, int N>
+void benchCreateSubclass() {
+  constexpr auto iterations = 1000000;
+
+  mt19937     rng(N);
+  vector<int> ids;
+  for (int i = 0; i < 1024; i++)
+    ids.push_back(rng() % N);
+
+  auto ns = measureNs("create_subclass/" + to_string(N), iterations, [&](int i) {
+    auto p = create_subclass<Root>(ids[i & 1023]);
+    doNotOptimize(p);
+    delete p;
+  });
+  ZBenchPrint("create_subclass %3d subclasses: %6.2f ns (new + delete)\n", N, ns);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// each_field over objects
+
+#define ZBenchNames8(p) p##0, p##1, p##2, p##3, p##4, p##5, p##6, p##7
+
+struct BenchFields8 {
+  TrefType(BenchFields8);
+
+  int ZBenchNames8(a);
+  TrefFields(ZBenchNames8(a));
+};
+
+struct BenchFields32 {
+  TrefType(BenchFields32);
+
+  int ZBenchNames8(a), ZBenchNames8(b), ZBenchNames8(c), ZBenchNames8(d);
+  TrefFields(ZBenchNames8(a), ZBenchNames8(b), ZBenchNames8(c));
+  TrefFields(ZBenchNames8(d));
+};
+
+struct BenchFields64 {
+  TrefType(BenchFields64);
+
+  int ZBenchNames8(a), ZBenchNames8(b), ZBenchNames8(c), ZBenchNames8(d);
+  int ZBenchNames8(e), ZBenchNames8(f), ZBenchNames8(g), ZBenchNames8(h);
+  TrefFields(ZBenchNames8(a), ZBenchNames8(b), ZBenchNames8(c));
+  TrefFields(ZBenchNames8(d), ZBenchNames8(e), ZBenchNames8(f));
+  TrefFields(ZBenchNames8(g), ZBenchNames8(h));
+};
+
+template <typename T>
+void benchEachField() {
+  constexpr auto iterations = 1000000;
+  constexpr auto n = tuple_size_v<decltype(class_fields_v<T>)>;
+
+  vector<T> objs(1024);
+  for (auto& o : objs)
+    each_field<T>([&](auto info) {
+      o.*(info.value) = (int)info.index;
+      return true;
+    });
+
+  auto ns = measureNs("each_field/" + to_string(n), iterations, [&](int i) {
+    int   sum = 0;
+    auto& o = objs[i & 1023];
+    each_field<T>([&](auto info) {
+      sum += o.*(info.value);
+      return true;
+    });
+    doNotOptimize(sum);
+  });
+
+  // Field names are looked up at runtime in scripts & tools.
+  auto lookupNs = measureNs("get_field_index/" + to_string(n), iterations / 10, [&](int i) {
+    char name[] = "a0";
+    name[1] = char('0' + i % 8);
+    doNotOptimize(class_info_v<T>.get_field_index(name));
+  });
+  ZBenchPrint("each_field %2zu fields: %6.2f ns/object, get_field_index %6.2f ns\n", n, ns, lookupNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// binary codec & runtime registry
+
+void benchCodec() {
+  constexpr auto iterations = 2000000;
+
+  vector<BenchRow> rows(1024);
+  mt19937          rng(0);
+  for (auto& r : rows) {
+    r.id = rng();
+    r.price = rng() / 100.0;
+    r.name = "item" + to_string(rng() % 1000);
+  }
+
+  string buf;
+  auto   encodeNs = measureNs("encode/BenchRow", iterations, [&](int i) {
+    buf.clear();
+    ByteWriter w(buf);
+    encode(w, rows[i & 1023]);
+    doNotOptimize(buf);
+  });
+
+  vector<string> encoded;
+  for (auto& r : rows) {
+    string     b;
+    ByteWriter w(b);
+    encode(w, r);
+    encoded.push_back(move(b));
+  }
+  BenchRow row;
+  auto     decodeNs = measureNs("decode/BenchRow", iterations, [&](int i) {
+    ByteReader r(encoded[i & 1023]);
+    doNotOptimize(decode(r, row));
+  });
+  ZBenchPrint("codec BenchRow: encode %6.2f ns, decode %6.2f ns\n", encodeNs, decodeNs);
+}
+
+template <typename = void>
+void benchBatchCodec() {
+  constexpr auto rows = 1 << 18;
+  constexpr auto iterations = 41;
+
+  vector<BenchRow> objs(rows);
+  mt19937          rng(0);
+  for (auto& r : objs) {
+    r.id = rng();
+    r.price = rng() / 100.0;
+    r.name = "item" + to_string(rng() % 1000);
+  }
+
+  string data;
+  encode_batch(data, objs);
+  for (unsigned threads : {1, 2, 4, 8, 16, 32}) {
+    string out;
+    auto   encodeNs = measureNs("encode_batch/" + to_string(threads), iterations, [&](int) {
+      out.clear();
+      encode_batch(out, objs, {threads});
+      doNotOptimize(out);
+    });
+    vector<BenchRow> decoded;
+    auto             decodeNs = measureNs("decode_batch/" + to_string(threads), iterations, [&](int) {
+      decoded.clear();
+      doNotOptimize(decode_batch(data, decoded, {threads}));
+    });
+    ZBenchPrint("batch codec %d rows, %2u threads: encode %6.2f ms, decode %6.2f ms\n", rows, threads,
+                encodeNs / 1e6, decodeNs / 1e6);
+  }
+}
+
+struct BenchReplica {
+  TrefType(BenchReplica);
+
+  uint32_t id = 0;
+  float    x = 0, y = 0, z = 0;
+  uint8_t  hp = 0;
+  BenchOp  op = BenchOp::Add;
+  bool     moving = false;
+  TrefFieldWithMeta(id, (MetaRange<uint32_t>{0, 65535}));
+  TrefFieldWithMeta(x, (MetaQuantized{-1024, 1024, 16}));
+  TrefFieldWithMeta(y, (MetaQuantized{-1024, 1024, 16}));
+  TrefFieldWithMeta(z, (MetaQuantized{-64, 64, 12}));
+  TrefFieldWithMeta(hp, (MetaRange<uint8_t>{0, 100}));
+  TrefField(op);
+  TrefField(moving);
+};
+
+void benchBitPacking() {
+  constexpr auto iterations = 2000000;
+
+  vector<BenchReplica> objs(1024);
+  mt19937              rng(0);
+  for (auto& o : objs) {
+    o.id = rng() % 65536;
+    o.x = float(rng() % 2048) - 1024;
+    o.y = float(rng() % 2048) - 1024;
+    o.z = float(rng() % 128) - 64;
+    o.hp = rng() % 101;
+    o.moving = rng() & 1;
+  }
+
+  string buf;
+  auto   bytesNs = measureNs("encode/BenchReplica", iterations, [&](int i) {
+    buf.clear();
+    ByteWriter w(buf);
+    encode(w, objs[i & 1023]);
+    doNotOptimize(buf);
+  });
+  auto bytesSize = buf.size();
+
+  auto bitsNs = measureNs("encode_bits/BenchReplica", iterations, [&](int i) {
+    buf.clear();
+    BitWriter w(buf);
+    doNotOptimize(encode_bits(w, objs[i & 1023]));
+  });
+
+  string all;
+  {
+    BitWriter w(all);
+    for (auto& o : objs)
+      encode_bits(w, o);
+  }
+  BenchReplica o;
+  BitReader    r(all);
+  auto         decodeNs = measureNs("decode_bits/BenchReplica", iterations, [&](int i) {
+    if ((i & 1023) == 0)
+      r = BitReader(all);
+    doNotOptimize(decode_bits(r, o));
+  });
+  ZBenchPrint(
+      "bit packing BenchReplica: %zu bytes -> %d bits, encode %6.2f ns, encode_bits %6.2f ns, "
+      "decode_bits %6.2f ns\n",
+      bytesSize, bit_size_v<BenchReplica>, bytesNs, bitsNs, decodeNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// batch validate vs per object each_field
+
+struct BenchImport {
+  TrefType(BenchImport);
+
+  int      x = 0;
+  int      y = 0;
+  float    hp = 0;
+  uint16_t count = 0;
+  TrefFieldWithMeta(x, (MetaRange<int>{-1000, 1000}));
+  TrefFieldWithMeta(y, (MetaRange<int>{-1000, 1000}));
+  TrefFieldWithMeta(hp, (MetaQuantized{0, 100, 10}));
+  TrefFieldWithMeta(count, (MetaRange<int>{0, 999}));
+};
+
+template <typename = void>
+void benchValidate() {
+  constexpr auto rows = 16384;
+  constexpr auto iterations = 400;
+
+  vector<BenchImport> objs(rows);
+  mt19937             rng(0);
+  for (auto& o : objs) {
+    o.x = int(rng() % 2001) - 1000;
+    o.y = int(rng() % 2001) - 1000;
+    o.hp = float(rng() % 100);
+    o.count = rng() % 1000;
+  }
+  objs[rows / 2].count = 1000;
+
+  auto batchNs = measureNs("validate/batch_16384", iterations, [&](int) {
+    auto r = validate(objs);
+    doNotOptimize(r);
+  });
+
+  columns_t<BenchImport> cols;
+  for (auto& o : objs) {
+    get<0>(cols).push_back(o.x);
+    get<1>(cols).push_back(o.y);
+    get<2>(cols).push_back(o.hp);
+    get<3>(cols).push_back(o.count);
+  }
+  auto columnsNs = measureNs("validate/columns_16384", iterations, [&](int) {
+    auto r = validate_columns<BenchImport>(cols);
+    doNotOptimize(r);
+  });
+
+  auto eachNs = measureNs("validate/each_field_16384", iterations, [&](int) {
+    vector<uint32_t> failed;
+    for (uint32_t i = 0; i < rows; i++) {
+      each_field<BenchImport>([&](auto info) {
+        using M = member_t<decltype(info.value)>;
+        if constexpr (is_same_v<decltype(info.meta), const MetaQuantized>) {
+          auto v = objs[i].*(info.value);
+          if (!(v >= info.meta.minV && v <= info.meta.maxV))
+            failed.push_back(i);
+        } else {
+          M v = objs[i].*(info.value);
+          if (v < info.meta.minV || v > info.meta.maxV)
+            failed.push_back(i);
+        }
+        return true;
+      });
+    }
+    doNotOptimize(failed);
+  });
+
+  ZBenchPrint("validate %d rows: batch %6.3f ns/row, columns %6.3f ns/row, each_field %6.3f ns/row\n",
+              rows, batchNs / rows, columnsNs / rows, eachNs / rows);
+}
+
+template <typename = void>
+void benchRuntimeRegistry() {
+  constexpr auto iterations = 4000000;
+
+  // Fill the tables with a few hundred classes.
+  register_class<VisitRoot200>();
+  register_class<BenchEntity>();
+  auto byNameNs = measureNs("find_class/name", iterations,
+                            [&](int) { doNotOptimize(find_class("BenchEntity"sv)); });
+  auto byTypeNs = measureNs("find_class/type", iterations,
+                            [&](int) { doNotOptimize(find_class(type_id<BenchEntity>())); });
+  ZBenchPrint("runtime registry: find_class by name %6.2f ns, by type %6.2f ns\n", byNameNs, byTypeNs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  string_view format = "text", filter;
+  for (int i = 1; i < argc; i++) {
+    string_view arg = argv[i];
+    if (arg == "--json" || arg == "--csv")
+      format = arg.substr(2);
+    else if (arg.substr(0, 9) == "--filter=")
+      filter = arg.substr(9);
+  }
+  if (format != "text")
+    benchLog = stderr;
+
+  auto run = [&](string_view name, auto f) {
+    if (name.find(filter) != string_view::npos)
+      f();
+  };
+  run("visit", [] { benchVisitAll(); });
+  run("clone", [] { benchClone(); });
+  run("enum_dispatch", benchEnumDispatch);
+  run("enum_names", [] {
+    benchEnumNames<BenchEnum4>();
+    benchEnumNames<BenchEnum16>();
+    benchEnumNames<BenchEnum30>();
+  });
+  run("create_subclass", [] {
+    benchCreateSubclass<VisitRoot10, 10>();
+    benchCreateSubclass<VisitRoot50, 50>();
+    benchCreateSubclass<VisitRoot200, 200>();
+  });
+  run("each_field", [] {
+    benchEachField<BenchFields8>();
+    benchEachField<BenchFields32>();
+    benchEachField<BenchFields64>();
+  });
+  run("codec", benchCodec);
+  run("batch_codec", [] { benchBatchCodec(); });
+  run("bit_packing", benchBitPacking);
+  run("validate", [] { benchValidate(); });
+  run("csv", benchCsv);
+  run("rpc", benchRpc);
+  run("hooks", benchHooks);
+  run("path", benchPath);
+  run("registry", [] { benchRuntimeRegistry(); });
+
+  printRecords(format);
+  return 0;
+}
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# Compile-time benchmarks of Tref: generate translation units, then record the
+# compile time, peak memory of the compiler and object size of each of them.
+#
+# Usage: python3 TrefCompileBench.py [--cxx g++] [--std c++17] [--cases fields,enums]
+#                                    [--sizes 10,100] [--json out.json]
+#                                    [--baseline old.json [--tolerance 0.25]]
+#
+# With --baseline, exit with 1 if any case is slower or bigger than in the
+# baseline by more than the tolerance, or fails to compile now.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+BULK = 30  # max arguments of ZTrefMap
+
+
+def chunks(items, n):
+    return [items[i:i + n] for i in range(0, len(items), n)]
+
+
+def gen_fields(n, bulk):
+    src = ['#include "Tref.hpp"', 'struct S {', '  TrefType(S);']
+    names = ['f%d' % i for i in range(n)]
+    src += ['  int %s;' % f for f in names]
+    if bulk:
+        src += ['  TrefFields(%s);' % ', '.join(c) for c in chunks(names, BULK)]
+    else:
+        src += ['  TrefField(%s);' % f for f in names]
+    src += ['};',
+            'int sum(S& s) {',
+            '  int r = 0;',
+            '  tref::class_info<S>().each_field([&](auto f, int) { r += s.*f.value; return true; });',
+            '  return r;',
+            '}']
+    return '\n'.join(src) + '\n'
+
+
+def gen_subclasses(n, bulk):
+    src = ['#include "Tref.hpp"', 'struct Root { TrefType(Root); };']
+    names = ['S%d' % i for i in range(n)]
+    src += ['struct %s : Root { TrefType(%s); };' % (s, s) for s in names]
+    if bulk:
+        src += ['TrefSubTypes(%s);' % ', '.join(c) for c in chunks(names, BULK)]
+    else:
+        src += ['TrefSubType(%s);' % s for s in names]
+    src += ['int count() {',
+            '  int r = 0;',
+            '  tref::class_info<Root>().each_subclass([&](auto, int) { return ++r; });',
+            '  return r;',
+            '}']
+    return '\n'.join(src) + '\n'
+
+
+# Inheritance chain of n classes, the fields of every base are flattened.
+def gen_depth(n):
+    src = ['#include "Tref.hpp"', 'struct C0 { TrefType(C0); int f0; TrefField(f0); };']
+    for i in range(1, n):
+        src.append('struct C%d : C%d { TrefType(C%d); int f%d; TrefField(f%d); };' % (i, i - 1, i, i, i))
+    src += ['int sum(C%d& c) {' % (n - 1),
+            '  int r = 0;',
+            '  tref::tuple_for_each(tref::class_fields_v<C%d>, [&](auto f) { r += c.*f.value; return true; });' % (n - 1),
+            '  return r;',
+            '}']
+    return '\n'.join(src) + '\n'
+
+
+def gen_enum(n):
+    items = ['E%d' % i for i in range(n)]
+    src = ['#include "Tref.hpp"',
+           'TrefEnum(Big, int, %s);' % ', '.join(items),
+           'const char* name(Big e) { return tref::enum_to_string(e).data(); }',
+           'Big parse(const char* s) { return tref::string_to_enum(s, Big::E0); }']
+    return '\n'.join(src) + '\n'
+
+
+# name -> [(macro, generator, default sizes)]
+CASES = {
+    'fields': [('TrefField', lambda n: gen_fields(n, False), [10, 100, 250, 500, 1000]),
+               ('TrefFields', lambda n: gen_fields(n, True), [10, 100, 250, 500, 1000])],
+    'subclasses': [('TrefSubType', lambda n: gen_subclasses(n, False), [10, 50, 100, 250, 500]),
+                   ('TrefSubTypes', lambda n: gen_subclasses(n, True), [10, 50, 100, 250, 500])],
+    'depth': [('TrefField', gen_depth, [10, 25, 50])],
+    'enums': [('TrefEnum', gen_enum, [10, 30, 100, 1000])],
+}
+
+
+# @return: (seconds, peak MB, object bytes), None if failed to compile, like
+# TrefField over TrefMaxElems or TrefEnum over the ZTrefMap limit.
+def compile_once(cxx, std, flags, src, obj):
+    start = time.perf_counter()
+    p = subprocess.Popen([cxx, '-std=' + std] + flags + ['-I', HERE, '-c', src, '-o', obj],
+                         stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(p.pid, 0)
+    elapsed = time.perf_counter() - start
+    if status != 0:
+        return None
+    # ru_maxrss is in KB on Linux, bytes on macOS.
+    peak = usage.ru_maxrss / (1024 * 1024 if sys.platform == 'darwin' else 1024)
+    return elapsed, peak, os.path.getsize(obj)
+
+
+def compare(results, baseline, tolerance):
+    old = {(r['case'], r['macro'], r['n']): r for r in baseline}
+    bad = []
+    for r in results:
+        o = old.get((r['case'], r['macro'], r['n']))
+        if not o or o['seconds'] is None:
+            continue
+        if r['seconds'] is None:
+            bad.append('%s %s %d: compile failed' % (r['case'], r['macro'], r['n']))
+            continue
+        for k in ('seconds', 'peak_mb', 'object_bytes'):
+            if r[k] > o[k] * (1 + tolerance):
+                bad.append('%s %s %d: %s %.2f -> %.2f' % (r['case'], r['macro'], r['n'], k, o[k], r[k]))
+    return bad
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--cxx', default=os.environ.get('CXX', 'g++'))
+    ap.add_argument('--std', default='c++17')
+    ap.add_argument('--flags', default='-O0', help='extra compiler flags, space separated')
+    ap.add_argument('--cases', default=','.join(CASES))
+    ap.add_argument('--sizes', help='override the default sizes of every case')
+    ap.add_argument('--json', help='write the results to this file')
+    ap.add_argument('--baseline', help='results of an earlier --json run to compare with')
+    ap.add_argument('--tolerance', type=float, default=0.25)
+    args = ap.parse_args()
+    sizes = [int(s) for s in args.sizes.split(',')] if args.sizes else None
+
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        print('%-12s %-14s %6s %9s %9s %12s' % ('case', 'macro', 'n', 'seconds', 'peak MB', 'object'))
+        for kind in args.cases.split(','):
+            for macro, gen, default_sizes in CASES[kind]:
+                for n in sizes or default_sizes:
+                    src = os.path.join(tmp, '%s_%s_%d.cpp' % (kind, macro, n))
+                    with open(src, 'w') as f:
+                        f.write(gen(n))
+                    r = compile_once(args.cxx, args.std, args.flags.split(), src, src + '.o')
+                    results.append({'case': kind, 'macro': macro, 'n': n,
+                                    'seconds': r and round(r[0], 3),
+                                    'peak_mb': r and round(r[1], 1),
+                                    'object_bytes': r and r[2]})
+                    if r:
+                        print('%-12s %-14s %6d %9.2f %9.1f %12d' % (kind, macro, n, r[0], r[1], r[2]))
+                    else:
+                        print('%-12s %-14s %6d %9s' % (kind, macro, n, 'failed'))
+                    sys.stdout.flush()
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'cxx': args.cxx, 'std': args.std, 'flags': args.flags, 'results': results}, f, indent=1)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            bad = compare(results, json.load(f)['results'], args.tolerance)
+        for b in bad:
+            print('regression: ' + b)
+        sys.exit(1 if bad else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,1712 @@
+// Tref data: bulk loading & binary encoding of reflected types, built on top of
+// Tref.hpp.
+
+/***********************************************************************
+Copyright 2019-2020 crazybie<soniced@sina.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TREF_DATA_H
+#define TREF_DATA_H
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ZTrefHasMmap 1
+#else
+#define ZTrefHasMmap 0
+#endif
+
+#include "Tref.hpp"
+
+// Most elements of a vector, or rows of a batch, decoded when they take no
+// bytes, e.g. empty classes. Their counts can not be bounded by the size of
+// the input.
+#ifndef TrefCodecMaxEmptyElems
+#define TrefCodecMaxEmptyElems (1 << 20)
+#endif
+
+namespace tref {
+namespace imp {
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// text value parsing
+///
+//////////////////////////////////////////////////////////////////////////
+
+// @return: false if `s` is not a valid value of V.
+template <typename V>
+bool parse_text(string_view s, V& v) {
+  if constexpr (is_same_v<V, bool>) {
+    if (s == "1" || s == "true" || s == "TRUE" || s == "True") {
+      v = true;
+    } else if (s == "0" || s == "false" || s == "FALSE" || s == "False" || s.empty()) {
+      v = false;
+    } else {
+      return false;
+    }
+    return true;
+  } else if constexpr (is_enum_v<V>) {
+    if constexpr (is_reflected_enum_v<V>) {
+      if constexpr (is_enum_flags_v<V>) {
+        auto invalid = static_cast<V>(~flags_bits(V{}));
+        v = string_to_flags(s, invalid);
+        return v != invalid;
+      } else {
+        auto idx = enum_index_of_name<V>(s);
+        if (idx >= 0) {
+          v = enum_info_v<V>.items[idx].value;
+          return true;
+        }
+      }
+    }
+    underlying_type_t<V> n{};
+    if (!parse_text(s, n))
+      return false;
+    v = static_cast<V>(n);
+    return true;
+  } else if constexpr (is_arithmetic_v<V>) {
+    if (s.empty()) {
+      v = V{};
+      return true;
+    }
+    auto b = s.data(), e = s.data() + s.size();
+    if (*b == '+' && ++b < e && (*b == '-' || *b == '+'))
+      return false;
+    auto r = std::from_chars(b, e, v);
+    return r.ec == std::errc{} && r.ptr == e;
+  } else if constexpr (is_assignable_v<V&, string_view>) {
+    v = s;
+    return true;
+  } else {
+    static_assert(is_constructible_v<V, string_view>, "can not parse this type from text");
+    v = V(s);
+    return true;
+  }
+}
+
+template <typename V>
+constexpr bool is_text_parsable_v =
+    is_arithmetic_v<V> || is_enum_v<V> || is_assignable_v<V&, string_view> ||
+    is_constructible_v<V, string_view>;
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// CSV/TSV loading
+///
+//////////////////////////////////////////////////////////////////////////
+
+struct CsvOptions {
+  // ',' for CSV, '\t' for TSV.
+  char sep = ',';
+  // 0 to use all cores.
+  unsigned threads = 0;
+  // Inputs smaller than this are parsed on the calling thread.
+  size_t min_chunk_size = 1 << 20;
+};
+
+struct CsvResult {
+  bool   ok = true;
+  size_t rows = 0;
+  // 0-based index of the data row containing the first invalid cell.
+  size_t error_row = 0;
+  // Header of the column of the invalid cell, or the repeated header of a
+  // field.
+  string_view error_column;
+};
+
+// Split csv text into cells, quoted cells support `""` as escaped quote.
+// Empty lines are skipped.
+// @param on_cell: [](size_t col, string_view cell) -> bool, return false to
+// stop the scanning.
+// @param on_row: [](size_t cols) -> bool, return false to stop the scanning.
+template <typename C, typename R>
+bool scan_csv(string_view data, char sep, string& scratch, C&& on_cell, R&& on_row) {
+  auto p = data.data();
+  auto end = p + data.size();
+  auto find = [](const char* b, const char* e, char c) {
+    auto r = (const char*)memchr(b, c, e - b);
+    return r ? r : e;
+  };
+
+  while (p < end) {
+    if (*p == '\n' || *p == '\r') {
+      p++;
+      continue;
+    }
+
+    auto   eol = find(p, end, '\n');
+    size_t col = 0;
+    while (true) {
+      string_view cell;
+      if (p < eol && *p == '"') {
+        auto s = ++p;
+        auto escaped = false;
+        scratch.clear();
+        while (p < end) {
+          if (*p == '"') {
+            if (p + 1 < end && p[1] == '"') {
+              scratch.append(s, p + 1);
+              p += 2;
+              s = p;
+              escaped = true;
+              continue;
+            }
+            break;
+          }
+          p++;
+        }
+        if (escaped) {
+          scratch.append(s, p);
+          cell = scratch;
+        } else {
+          cell = {s, size_t(p - s)};
+        }
+        // the quoted cell may contain new lines.
+        if (p >= eol)
+          eol = find(min(p, end), end, '\n');
+        while (p < eol && *p != sep)
+          p++;
+      } else {
+        auto s = p;
+        p = find(p, eol, sep);
+        cell = {s, size_t(p - s)};
+        if (p == eol && !cell.empty() && cell.back() == '\r')
+          cell.remove_suffix(1);
+      }
+
+      if (!on_cell(col++, cell))
+        return false;
+      if (p < eol) {
+        p++;
+        continue;
+      }
+      break;
+    }
+    p = eol + (eol < end);
+    if (!on_row(col))
+      return false;
+  }
+  return true;
+}
+
+// Split `body` into about `n` chunks at record boundaries.
+// A new line is a boundary only when preceded by an even number of quotes,
+// so quoted cells containing new lines stay in one chunk (quotes are
+// expected to only enclose cells, as in RFC 4180).
+inline vector<string_view> split_records(string_view body, size_t n) {
+  vector<string_view> ret;
+  auto                counted = body.data();
+  auto                quoted = false;
+  auto                isBoundary = [&](const char* eol) {
+    while (auto q = (const char*)memchr(counted, '"', eol - counted)) {
+      quoted = !quoted;
+      counted = q + 1;
+    }
+    counted = eol;
+    return !quoted;
+  };
+  while (n > 1 && !body.empty()) {
+    auto p = body.find('\n', body.size() / n);
+    while (p != string_view::npos && !isBoundary(body.data() + p))
+      p = body.find('\n', p + 1);
+    if (p == string_view::npos)
+      break;
+    ret.push_back(body.substr(0, p + 1));
+    body.remove_prefix(p + 1);
+    n--;
+  }
+  if (!body.empty())
+    ret.push_back(body);
+  return ret;
+}
+
+// Guess the line count of `chunk` from its leading lines.
+inline size_t estimate_lines(string_view chunk) {
+  auto head = chunk.substr(0, 4096);
+  auto lines = (size_t)count(head.begin(), head.end(), '\n');
+  return lines ? chunk.size() / max<size_t>(1, head.size() / lines) + 1 : 1;
+}
+
+// Run `f(chunkIndex, chunk)` for every chunk, in parallel when worth it.
+template <typename F>
+void each_chunk_parallel(const vector<string_view>& chunks, F&& f) {
+  if (chunks.size() <= 1) {
+    if (!chunks.empty())
+      f(0, chunks[0]);
+    return;
+  }
+  vector<thread> workers;
+  for (size_t i = 1; i < chunks.size(); i++)
+    workers.emplace_back([&, i] { f(i, chunks[i]); });
+  f(0, chunks[0]);
+  for (auto& w : workers)
+    w.join();
+}
+
+inline vector<string_view> csv_chunks(string_view body, const CsvOptions& opt) {
+  size_t n = opt.threads ? opt.threads : max(1u, thread::hardware_concurrency());
+  n = min(n, max<size_t>(1, body.size() / max<size_t>(1, opt.min_chunk_size)));
+  return split_records(body, n);
+}
+
+// Parse a cell into the I-th field of T.
+template <typename T, size_t I>
+bool csv_set_field(T& obj, string_view cell) {
+  constexpr auto info = get<I>(class_fields_v<T>);
+  return parse_text(cell, obj.*(info.value));
+}
+
+template <typename T>
+using CsvFieldSetter = bool (*)(T&, string_view);
+
+// Whether the I-th field of T is a data member can be loaded from text.
+template <typename T, size_t I>
+constexpr bool is_csv_field() {
+  using V = decltype(get<I>(class_fields_v<T>).value);
+  if constexpr (is_member_object_pointer_v<V>)
+    return is_text_parsable_v<member_t<V>> && !is_const_v<member_t<V>>;
+  return false;
+}
+
+template <typename T, size_t I>
+constexpr CsvFieldSetter<T> csv_field_setter() {
+  if constexpr (is_csv_field<T, I>())
+    return &csv_set_field<T, I>;
+  return nullptr;
+}
+
+template <typename T, size_t... I>
+constexpr auto csv_field_setters(index_sequence<I...>) {
+  return array<CsvFieldSetter<T>, sizeof...(I)>{csv_field_setter<T, I>()...};
+}
+
+// Setters indexed by the field index of `class_fields_v<T>`, nullptr for
+// fields can not be loaded from text.
+template <typename T>
+constexpr auto csv_field_setters_v =
+    csv_field_setters<T>(make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+
+// Map each column of the header line to a field index, -1 for unknown ones.
+// @param duplicate: set to the column repeating the header of a field.
+template <typename T>
+string_view map_csv_header(string_view data, char sep, vector<int>& columns, size_t& duplicate) {
+  auto p = data.find('\n');
+  auto header = data.substr(0, p);
+  string scratch;
+  duplicate = string_view::npos;
+  scan_csv(
+      header, sep, scratch,
+      [&](size_t col, string_view name) {
+        auto idx = class_info_v<T>.get_field_index(name);
+        if (idx < 0 || !csv_field_setters_v<T>[idx])
+          idx = -1;
+        else if (find(columns.begin(), columns.end(), idx) != columns.end())
+          duplicate = min(duplicate, col);
+        columns.push_back(idx);
+        return true;
+      },
+      [](size_t) { return true; });
+  return p == string_view::npos ? string_view{} : data.substr(p + 1);
+}
+
+template <typename T>
+string_view csv_column_name(string_view data, char sep, size_t col) {
+  string_view ret;
+  string      scratch;
+  scan_csv(
+      data.substr(0, data.find('\n')), sep, scratch,
+      [&](size_t i, string_view name) {
+        if (i == col)
+          ret = name;
+        return true;
+      },
+      [](size_t) { return false; });
+  return ret;
+}
+
+// Load rows of a CSV/TSV text into `out`, the header line names the fields.
+// Unknown columns are ignored, missing fields are value-initialized, a field
+// named twice fails.
+// Nothing is appended to `out` if any cell is invalid.
+template <typename T>
+CsvResult load_csv(string_view data, vector<T>& out, const CsvOptions& opt = {}) {
+  static_assert(is_reflected_v<T>);
+
+  CsvResult   ret;
+  vector<int> columns;
+  size_t      duplicate;
+  auto        body = map_csv_header<T>(data, opt.sep, columns, duplicate);
+  if (duplicate != string_view::npos) {
+    ret.ok = false;
+    ret.error_column = csv_column_name<T>(data, opt.sep, duplicate);
+    return ret;
+  }
+  auto chunks = csv_chunks(body, opt);
+
+  vector<CsvFieldSetter<T>> setterOfColumn;
+  for (auto i : columns)
+    setterOfColumn.push_back(i >= 0 ? csv_field_setters_v<T>[i] : nullptr);
+
+  struct ChunkResult {
+    vector<T> rows;
+    bool      ok = true;
+    size_t    error_col = 0;
+  };
+  vector<ChunkResult> results(chunks.size());
+
+  each_chunk_parallel(chunks, [&](size_t idx, string_view chunk) {
+    auto&  r = results[idx];
+    auto   setters = setterOfColumn.data();
+    auto   cols = setterOfColumn.size();
+    T*     row = nullptr;
+    string scratch;
+    r.rows.reserve(estimate_lines(chunk));
+    scan_csv(
+        chunk, opt.sep, scratch,
+        [&](size_t col, string_view cell) {
+          if (col == 0)
+            row = &r.rows.emplace_back();
+          if (col < cols && setters[col] && !setters[col](*row, cell)) {
+            r.ok = false;
+            r.error_col = col;
+            return false;
+          }
+          return true;
+        },
+        [](size_t) { return true; });
+  });
+
+  for (auto& r : results) {
+    if (!r.ok) {
+      ret.ok = false;
+      ret.error_row = ret.rows + r.rows.size() - 1;
+      ret.error_column = csv_column_name<T>(data, opt.sep, r.error_col);
+      ret.rows = 0;
+      return ret;
+    }
+    ret.rows += r.rows.size();
+  }
+  if (out.empty() && results.size() == 1) {
+    out.swap(results[0].rows);
+    return ret;
+  }
+  out.reserve(out.size() + ret.rows);
+  for (auto& r : results)
+    move(r.rows.begin(), r.rows.end(), back_inserter(out));
+  return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// column storage
+
+template <typename T, size_t I>
+auto column_of() {
+  using V = decltype(get<I>(class_fields_v<T>).value);
+  if constexpr (is_member_object_pointer_v<V>) {
+    return vector<remove_const_t<member_t<V>>>{};
+  } else {
+    return tuple<>{};
+  }
+}
+
+template <typename T, size_t... I>
+auto columns_of(index_sequence<I...>) -> tuple<decltype(column_of<T, I>())...>;
+
+// One vector per data member of T (including the base classes), indexed
+// by the field index, `tuple<>` for the other fields.
+template <typename T>
+using columns_t =
+    decltype(columns_of<T>(make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>()));
+
+template <typename T>
+using CsvColumnSetter = bool (*)(columns_t<T>&, string_view);
+
+template <typename T, size_t I>
+bool csv_push_column(columns_t<T>& cols, string_view cell) {
+  typename tuple_element_t<I, columns_t<T>>::value_type v{};
+  if (!parse_text(cell, v))
+    return false;
+  get<I>(cols).push_back(move(v));
+  return true;
+}
+
+template <typename T, size_t I>
+constexpr CsvColumnSetter<T> csv_column_setter() {
+  if constexpr (is_csv_field<T, I>())
+    return &csv_push_column<T, I>;
+  return nullptr;
+}
+
+template <typename T, size_t I>
+void csv_push_default(columns_t<T>& cols) {
+  if constexpr (!is_same_v<tuple_element_t<I, columns_t<T>>, tuple<>>)
+    get<I>(cols).emplace_back();
+}
+
+template <typename T, size_t... I>
+constexpr auto csv_column_setters(index_sequence<I...>) {
+  using Default = void (*)(columns_t<T>&);
+  return make_pair(array<CsvColumnSetter<T>, sizeof...(I)>{csv_column_setter<T, I>()...},
+                   array<Default, sizeof...(I)>{&csv_push_default<T, I>...});
+}
+
+template <typename T, size_t... I>
+void append_columns(columns_t<T>& dst, columns_t<T>& src, index_sequence<I...>) {
+  auto append = [](auto& d, auto& s) {
+    if constexpr (!is_same_v<decay_t<decltype(d)>, tuple<>>)
+      move(s.begin(), s.end(), back_inserter(d));
+  };
+  (append(get<I>(dst), get<I>(src)), ...);
+}
+
+// Same as load_csv but store the rows column by column.
+template <typename T>
+CsvResult load_csv_columns(string_view data, columns_t<T>& out, const CsvOptions& opt = {}) {
+  static_assert(is_reflected_v<T>);
+  constexpr auto fieldCnt = tuple_size_v<columns_t<T>>;
+  constexpr auto setters = csv_column_setters<T>(make_index_sequence<fieldCnt>());
+
+  CsvResult   ret;
+  vector<int> columns;
+  size_t      duplicate;
+  auto        body = map_csv_header<T>(data, opt.sep, columns, duplicate);
+  if (duplicate != string_view::npos) {
+    ret.ok = false;
+    ret.error_column = csv_column_name<T>(data, opt.sep, duplicate);
+    return ret;
+  }
+  auto chunks = csv_chunks(body, opt);
+
+  // fields without column, filled with default values.
+  vector<int> missing;
+  for (size_t i = 0; i < fieldCnt; i++) {
+    if (find(columns.begin(), columns.end(), (int)i) == columns.end())
+      missing.push_back((int)i);
+  }
+
+  struct ChunkResult {
+    columns_t<T> cols;
+    size_t       rows = 0;
+    bool         ok = true;
+    size_t       error_col = 0;
+  };
+  vector<ChunkResult> results(chunks.size());
+
+  each_chunk_parallel(chunks, [&](size_t idx, string_view chunk) {
+    auto&  r = results[idx];
+    string scratch;
+    scan_csv(
+        chunk, opt.sep, scratch,
+        [&](size_t col, string_view cell) {
+          if (col < columns.size() && columns[col] >= 0) {
+            if (!setters.first[columns[col]](r.cols, cell)) {
+              r.ok = false;
+              r.error_col = col;
+              return false;
+            }
+          }
+          return true;
+        },
+        [&](size_t cols) {
+          for (auto i = cols; i < columns.size(); i++) {
+            if (columns[i] >= 0)
+              setters.second[columns[i]](r.cols);
+          }
+          for (auto i : missing)
+            setters.second[i](r.cols);
+          r.rows++;
+          return true;
+        });
+  });
+
+  for (auto& r : results) {
+    if (!r.ok) {
+      ret.ok = false;
+      ret.error_row = ret.rows + r.rows;
+      ret.error_column = csv_column_name<T>(data, opt.sep, r.error_col);
+      ret.rows = 0;
+      return ret;
+    }
+    ret.rows += r.rows;
+  }
+  for (auto& r : results)
+    append_columns<T>(out, r.cols, make_index_sequence<fieldCnt>());
+  return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// file loading
+
+// Read-only view of a whole file, memory mapped when supported.
+class MappedFile {
+ public:
+  explicit MappedFile(const char* path) {
+#if ZTrefHasMmap
+    auto fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      auto p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+        data_ = {(const char*)p, (size_t)st.st_size};
+        mapped_ = ok_ = true;
+      }
+    }
+    ::close(fd);
+#endif
+    if (!mapped_) {
+      if (auto f = fopen(path, "rb")) {
+        char buf[1 << 16];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;)
+          buffer_.append(buf, n);
+        ok_ = !ferror(f);
+        fclose(f);
+        data_ = buffer_;
+      }
+    }
+  }
+
+  ~MappedFile() {
+#if ZTrefHasMmap
+    if (mapped_)
+      ::munmap((void*)data_.data(), data_.size());
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  string_view data() const { return data_; }
+  // false if the file can not be opened or read.
+  bool ok() const { return ok_; }
+
+ private:
+  string_view data_;
+  string      buffer_;
+  bool        mapped_ = false;
+  bool        ok_ = false;
+};
+
+// @return: `ok` is false if the file can not be read.
+template <typename T>
+CsvResult load_csv_file(const char* path, vector<T>& out, const CsvOptions& opt = {}) {
+  MappedFile f(path);
+  if (!f.ok()) {
+    CsvResult ret;
+    ret.ok = false;
+    return ret;
+  }
+  return load_csv(f.data(), out, opt);
+}
+
+template <typename T>
+CsvResult load_csv_columns_file(const char* path, columns_t<T>& out, const CsvOptions& opt = {}) {
+  MappedFile f(path);
+  if (!f.ok()) {
+    CsvResult ret;
+    ret.ok = false;
+    return ret;
+  }
+  return load_csv_columns<T>(f.data(), out, opt);
+}
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// binary codec
+///
+/// Compact format in host byte order:
+/// - arithmetic & enum: raw bytes.
+/// - string & string_view: uint32 length + bytes.
+/// - vector: uint32 count + elements.
+/// - array, pair, tuple: elements.
+/// - reflected class: data members in field order, including base classes.
+///
+//////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+struct is_vector : false_type {};
+template <typename T, typename A>
+struct is_vector<vector<T, A>> : true_type {};
+
+template <typename T>
+struct is_std_array : false_type {};
+template <typename T, size_t N>
+struct is_std_array<array<T, N>> : true_type {};
+
+template <typename T>
+struct is_tuple_like : false_type {};
+template <typename... T>
+struct is_tuple_like<tuple<T...>> : true_type {};
+template <typename A, typename B>
+struct is_tuple_like<pair<A, B>> : true_type {};
+
+template <typename V>
+constexpr bool is_codable();
+
+template <typename TP, size_t... I>
+constexpr bool is_tuple_codable(index_sequence<I...>) {
+  return (is_codable<remove_cv_t<tuple_element_t<I, TP>>>() && ...);
+}
+
+template <typename T, size_t... I>
+constexpr bool is_class_codable(index_sequence<I...>) {
+  [[maybe_unused]] auto codable = [](auto info) {
+    using V = decltype(info.value);
+    if constexpr (is_member_object_pointer_v<V>)
+      return is_codable<remove_cv_t<member_t<V>>>();
+    return true;
+  };
+  return (codable(get<I>(class_fields_v<T>)) && ...);
+}
+
+// Whether V can be encoded by `encode` and decoded by `decode`.
+template <typename V>
+constexpr bool is_codable() {
+  if constexpr (is_arithmetic_v<V> || is_enum_v<V> || is_same_v<V, string> ||
+                is_same_v<V, string_view>) {
+    return true;
+  } else if constexpr (is_vector<V>::value || is_std_array<V>::value) {
+    return is_codable<typename V::value_type>();
+  } else if constexpr (is_tuple_like<V>::value) {
+    return is_tuple_codable<V>(make_index_sequence<tuple_size_v<V>>());
+  } else if constexpr (is_reflected_v<V>) {
+    return is_class_codable<V>(make_index_sequence<tuple_size_v<decltype(class_fields_v<V>)>>());
+  } else {
+    return false;
+  }
+}
+
+template <typename V>
+constexpr bool is_codable_v = is_codable<V>();
+
+template <typename V>
+constexpr size_t min_encoded_size();
+
+template <typename TP, size_t... I>
+constexpr size_t min_tuple_encoded_size(index_sequence<I...>) {
+  return (size_t(0) + ... + min_encoded_size<remove_cv_t<tuple_element_t<I, TP>>>());
+}
+
+template <typename T, size_t... I>
+constexpr size_t min_class_encoded_size(index_sequence<I...>) {
+  [[maybe_unused]] auto size = [](auto info) {
+    using V = decltype(info.value);
+    if constexpr (is_member_object_pointer_v<V>)
+      return min_encoded_size<remove_cv_t<member_t<V>>>();
+    return size_t(0);
+  };
+  return (size_t(0) + ... + size(get<I>(class_fields_v<T>)));
+}
+
+// Fewest bytes of an encoded V, 0 for empty classes and tuples.
+template <typename V>
+constexpr size_t min_encoded_size() {
+  if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    return sizeof(V);
+  } else if constexpr (is_same_v<V, string> || is_same_v<V, string_view> || is_vector<V>::value) {
+    return sizeof(uint32_t);
+  } else if constexpr (is_std_array<V>::value) {
+    return tuple_size_v<V> * min_encoded_size<typename V::value_type>();
+  } else if constexpr (is_tuple_like<V>::value) {
+    return min_tuple_encoded_size<V>(make_index_sequence<tuple_size_v<V>>());
+  } else {
+    return min_class_encoded_size<V>(make_index_sequence<tuple_size_v<decltype(class_fields_v<V>)>>());
+  }
+}
+
+// Whether `n` values of V may fit in `bytes`, guards against bogus counts.
+template <typename V>
+constexpr bool encoded_count_fits(uint64_t n, size_t bytes) {
+  constexpr auto size = min_encoded_size<V>();
+  return size ? n <= bytes / size : n <= TrefCodecMaxEmptyElems;
+}
+
+// Append encoded values to a buffer, the buffer can be reused to avoid
+// allocations.
+class ByteWriter {
+ public:
+  explicit ByteWriter(string& buf) : buf_{buf} {}
+
+  void write(const void* p, size_t n) { buf_.append((const char*)p, n); }
+
+  template <typename V>
+  void write_raw(V v) {
+    write(&v, sizeof(v));
+  }
+
+  size_t size() const { return buf_.size(); }
+
+  // Reserve `n` bytes to be written later by `patch`.
+  size_t skip(size_t n) {
+    auto pos = buf_.size();
+    buf_.resize(pos + n);
+    return pos;
+  }
+
+  template <typename V>
+  void patch(size_t pos, V v) {
+    memcpy(&buf_[pos], &v, sizeof(v));
+  }
+
+  string& buffer() { return buf_; }
+
+ private:
+  string& buf_;
+};
+
+// Read encoded values from a buffer, never reads out of bounds: `ok()`
+// turns false on the first truncated read.
+class ByteReader {
+ public:
+  explicit ByteReader(string_view data) : p_{data.data()}, end_{data.data() + data.size()} {}
+
+  bool read(void* dst, size_t n) {
+    if (!ok_ || size_t(end_ - p_) < n)
+      return ok_ = false;
+    memcpy(dst, p_, n);
+    p_ += n;
+    return true;
+  }
+
+  template <typename V>
+  bool read_raw(V& v) {
+    return read(&v, sizeof(v));
+  }
+
+  // View of the next `n` bytes without copying.
+  string_view view(size_t n) {
+    if (!ok_ || size_t(end_ - p_) < n) {
+      ok_ = false;
+      return {};
+    }
+    string_view ret{p_, n};
+    p_ += n;
+    return ret;
+  }
+
+  bool   ok() const { return ok_; }
+  void   fail() { ok_ = false; }
+  size_t remaining() const { return end_ - p_; }
+  const char* pos() const { return p_; }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool        ok_ = true;
+};
+
+template <typename V>
+void encode(ByteWriter& w, const V& v);
+
+template <typename V>
+bool decode(ByteReader& r, V& v);
+
+template <typename T, size_t... I>
+void encode_fields(ByteWriter& w, const T& v, index_sequence<I...>) {
+  [[maybe_unused]] auto each = [&](auto info) {
+    if constexpr (is_member_object_pointer_v<decltype(info.value)>)
+      encode(w, v.*(info.value));
+  };
+  (each(get<I>(class_fields_v<T>)), ...);
+}
+
+template <typename T, size_t... I>
+bool decode_fields(ByteReader& r, T& v, index_sequence<I...>) {
+  [[maybe_unused]] auto each = [&](auto info) {
+    if constexpr (is_member_object_pointer_v<decltype(info.value)>)
+      return decode(r, v.*(info.value));
+    return true;
+  };
+  return (each(get<I>(class_fields_v<T>)) && ...);
+}
+
+template <typename V>
+void encode(ByteWriter& w, const V& v) {
+  static_assert(is_codable_v<V>, "type not supported by the binary codec");
+
+  if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    w.write_raw(v);
+  } else if constexpr (is_same_v<V, string> || is_same_v<V, string_view>) {
+    w.write_raw((uint32_t)v.size());
+    w.write(v.data(), v.size());
+  } else if constexpr (is_vector<V>::value || is_std_array<V>::value) {
+    using E = typename V::value_type;
+    if constexpr (is_vector<V>::value)
+      w.write_raw((uint32_t)v.size());
+    if constexpr ((is_arithmetic_v<E> || is_enum_v<E>) && !is_same_v<E, bool>) {
+      w.write(v.data(), v.size() * sizeof(E));
+    } else {
+      // const E& also binds to the proxy values of vector<bool>.
+      for (const E& e : v)
+        encode(w, e);
+    }
+  } else if constexpr (is_tuple_like<V>::value) {
+    apply([&](auto&... e) { (encode(w, e), ...); }, v);
+  } else {
+    encode_fields(w, v, make_index_sequence<tuple_size_v<decltype(class_fields_v<V>)>>());
+  }
+}
+
+// NOTE: decoded string_view refers to the buffer of the reader.
+template <typename V>
+bool decode(ByteReader& r, V& v) {
+  static_assert(is_codable_v<V>, "type not supported by the binary codec");
+
+  if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    return r.read_raw(v);
+  } else if constexpr (is_same_v<V, string> || is_same_v<V, string_view>) {
+    uint32_t n = 0;
+    if (!r.read_raw(n))
+      return false;
+    auto s = r.view(n);
+    v = V(s);
+    return r.ok();
+  } else if constexpr (is_vector<V>::value || is_std_array<V>::value) {
+    using E = typename V::value_type;
+    if constexpr (is_vector<V>::value) {
+      uint32_t n = 0;
+      if (!r.read_raw(n))
+        return false;
+      if (!encoded_count_fits<E>(n, r.remaining())) {
+        r.fail();
+        return false;
+      }
+      v.resize(n);
+    }
+    if constexpr ((is_arithmetic_v<E> || is_enum_v<E>) && !is_same_v<E, bool>) {
+      return r.read(v.data(), v.size() * sizeof(E));
+    } else if constexpr (is_same_v<V, vector<bool>>) {
+      for (size_t i = 0; i < v.size(); i++) {
+        bool e;
+        if (!decode(r, e))
+          return false;
+        v[i] = e;
+      }
+      return true;
+    } else {
+      for (auto& e : v)
+        if (!decode(r, e))
+          return false;
+      return true;
+    }
+  } else if constexpr (is_tuple_like<V>::value) {
+    return apply([&](auto&... e) { return (decode(r, e) && ...); }, v);
+  } else {
+    return decode_fields(r, v, make_index_sequence<tuple_size_v<decltype(class_fields_v<V>)>>());
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// batch encoding
+//
+// Rows are split into chunks encoded in parallel, the output starts with an
+// index so that the chunks can also be decoded in parallel:
+// - uint64 row count, uint32 chunk count.
+// - per chunk: uint32 row count, uint64 byte size.
+// - the encoded rows of every chunk, in order.
+
+struct BatchOptions {
+  // 0 to use all cores.
+  unsigned threads = 0;
+  // Rows per chunk, more chunks than threads balance uneven rows.
+  size_t chunk_rows = 4096;
+};
+
+// Run `f(worker, task)` for tasks in [0, n) on up to `threads` threads, an
+// idle thread claims the next task so slow tasks don't stall the others.
+template <typename F>
+void each_task_parallel(size_t n, unsigned threads, F&& f) {
+  size_t workers = threads ? threads : max(1u, thread::hardware_concurrency());
+  workers = min(workers, n);
+  atomic<size_t> next{0};
+  auto           work = [&](size_t worker) {
+    for (size_t t; (t = next.fetch_add(1, memory_order_relaxed)) < n;)
+      f(worker, t);
+  };
+  vector<thread> pool;
+  for (size_t i = 1; i < workers; i++)
+    pool.emplace_back(work, i);
+  work(0);
+  for (auto& t : pool)
+    t.join();
+}
+
+// Append the encoded rows to `out`, see above for the format.
+template <typename T>
+void encode_batch(string& out, const T* rows, size_t count, const BatchOptions& opt = {}) {
+  static_assert(is_codable_v<T>, "type not supported by the binary codec");
+
+  auto chunkRows = max<size_t>(1, opt.chunk_rows);
+  auto chunks = (count + chunkRows - 1) / chunkRows;
+  auto workers = opt.threads ? opt.threads : max(1u, thread::hardware_concurrency());
+
+  // Chunks are appended to the buffer of the thread encoding them.
+  struct ChunkSpan {
+    size_t worker = 0, offset = 0, size = 0;
+  };
+  vector<string>    buffers(min<size_t>(workers, max<size_t>(1, chunks)));
+  vector<ChunkSpan> spans(chunks);
+  each_task_parallel(chunks, opt.threads, [&](size_t worker, size_t c) {
+    auto&      buf = buffers[worker];
+    ByteWriter w(buf);
+    auto       begin = c * chunkRows, end = min(count, begin + chunkRows);
+    spans[c] = {worker, buf.size(), 0};
+    for (auto i = begin; i < end; i++)
+      encode(w, rows[i]);
+    spans[c].size = buf.size() - spans[c].offset;
+  });
+
+  ByteWriter w(out);
+  w.write_raw(uint64_t(count));
+  w.write_raw(uint32_t(chunks));
+  for (size_t c = 0; c < chunks; c++) {
+    w.write_raw(uint32_t(min(count - c * chunkRows, chunkRows)));
+    w.write_raw(uint64_t(spans[c].size));
+  }
+
+  // Join the thread buffers in chunk order.
+  vector<size_t> dst(chunks);
+  auto           pos = out.size();
+  for (size_t c = 0; c < chunks; c++) {
+    dst[c] = pos;
+    pos += spans[c].size;
+  }
+  out.resize(pos);
+  each_task_parallel(chunks, opt.threads, [&](size_t, size_t c) {
+    memcpy(&out[dst[c]], buffers[spans[c].worker].data() + spans[c].offset, spans[c].size);
+  });
+}
+
+template <typename T>
+void encode_batch(string& out, const vector<T>& rows, const BatchOptions& opt = {}) {
+  encode_batch(out, rows.data(), rows.size(), opt);
+}
+
+// Append the rows encoded by encode_batch to `out`, the chunks are decoded in
+// parallel. Nothing is appended to `out` if the data is invalid.
+// NOTE: decoded string_view refers to `data`.
+template <typename T>
+bool decode_batch(string_view data, vector<T>& out, const BatchOptions& opt = {}) {
+  static_assert(is_codable_v<T>, "type not supported by the binary codec");
+
+  ByteReader r(data);
+  uint64_t   rows = 0;
+  uint32_t   chunks = 0;
+  if (!r.read_raw(rows) || !r.read_raw(chunks) || chunks > r.remaining() / 12)
+    return false;
+
+  struct Chunk {
+    size_t      first = 0, rows = 0;
+    uint64_t    size = 0;
+    string_view bytes;
+  };
+  vector<Chunk> index(chunks);
+  size_t        first = 0;
+  for (auto& c : index) {
+    uint32_t n = 0;
+    r.read_raw(n);
+    r.read_raw(c.size);
+    c.first = first;
+    c.rows = n;
+    first += n;
+  }
+  for (auto& c : index)
+    c.bytes = r.view(c.size);
+  if (!r.ok() || r.remaining() || first != rows || !encoded_count_fits<T>(rows, data.size()))
+    return false;
+
+  auto old = out.size();
+  out.resize(old + rows);
+  atomic<bool> ok{true};
+  each_task_parallel(chunks, opt.threads, [&](size_t, size_t i) {
+    auto&      c = index[i];
+    ByteReader cr(c.bytes);
+    for (size_t k = 0; k < c.rows; k++) {
+      if (!ok.load(memory_order_relaxed) || !decode(cr, out[old + c.first + k])) {
+        ok = false;
+        return;
+      }
+    }
+    if (cr.remaining())
+      ok = false;
+  });
+  if (!ok) {
+    out.resize(old);
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// bit packing
+///
+/// Fields written with the fewest bits their type and meta allow, the
+/// stream is filled from the lowest bit of each byte:
+/// - bool: 1 bit.
+/// - reflected enum: item index, or the bits used by the items for flags.
+/// - integer with MetaRange: value - min in bit_width(max - min) bits.
+/// - floating point with MetaQuantized: one of 2^bits steps over the range.
+/// - floating point with MetaRange: raw bits, the range is only checked.
+/// - flags: values with bits not used by the items fail.
+/// - other arithmetic & enum: raw bits.
+/// - std::array: elements, the field meta applies to each of them.
+/// - reflected class: data members in field order, including base classes.
+///
+//////////////////////////////////////////////////////////////////////////
+
+// Field meta of numbers: values out of [minV, maxV] fail the encoding.
+// Combine it with other metas by deriving from it or by Metas<...>.
+template <typename T>
+struct MetaRange {
+  T minV, maxV;
+
+  constexpr MetaRange(T minV_, T maxV_) : minV(minV_), maxV(maxV_) {}
+};
+
+// Field meta of floating points: values in [minV, maxV] rounded to the
+// nearest of 2^bits evenly spaced steps, out of range values fail the
+// encoding.
+struct MetaQuantized {
+  double minV, maxV;
+  int    bits;
+};
+
+template <typename T>
+constexpr const MetaRange<T>* as_range_meta(const MetaRange<T>* m) {
+  return m;
+}
+constexpr const void* as_range_meta(const void*) {
+  return nullptr;
+}
+
+template <typename Meta>
+constexpr bool is_range_meta_v = !is_same_v<decltype(as_range_meta((const Meta*)0)), const void*>;
+
+constexpr int bit_width64(uint64_t v) {
+  int n = 0;
+  for (; v; v >>= 1)
+    n++;
+  return n;
+}
+
+template <typename E>
+constexpr uint64_t enum_flags_mask_v = [] {
+  uint64_t ret = 0;
+  for (auto& e : enum_info_v<E>.items)
+    ret |= flags_bits(e.value);
+  return ret;
+}();
+
+// Append bits to a buffer, the last partial byte is written by `flush`,
+// which is also called on destruction.
+class BitWriter {
+ public:
+  explicit BitWriter(string& buf) : buf_{buf} {}
+  ~BitWriter() { flush(); }
+
+  // Write the low `n` bits of `v`, n <= 64.
+  void write(uint64_t v, int n) {
+    if (n > 32) {
+      write(v & 0xffffffff, 32);
+      v >>= 32;
+      n -= 32;
+    }
+    acc_ |= (v & ((uint64_t(1) << n) - 1)) << used_;
+    used_ += n;
+    while (used_ >= 8) {
+      buf_.push_back(char(acc_));
+      acc_ >>= 8;
+      used_ -= 8;
+    }
+  }
+
+  void flush() {
+    if (used_) {
+      buf_.push_back(char(acc_));
+      acc_ = 0;
+      used_ = 0;
+    }
+  }
+
+  size_t bits() const { return buf_.size() * 8 + used_; }
+
+ private:
+  string&  buf_;
+  uint64_t acc_ = 0;
+  int      used_ = 0;
+};
+
+// Read bits from a buffer, never reads out of bounds: `ok()` turns false on
+// the first truncated read.
+class BitReader {
+ public:
+  explicit BitReader(string_view data) : p_{data.data()}, end_{data.data() + data.size()} {}
+
+  // Read `n` bits, n <= 64.
+  uint64_t read(int n) {
+    if (n > 32) {
+      auto lo = read(32);
+      return lo | read(n - 32) << 32;
+    }
+    while (avail_ < n) {
+      if (p_ == end_) {
+        ok_ = false;
+        return 0;
+      }
+      acc_ |= uint64_t(uint8_t(*p_++)) << avail_;
+      avail_ += 8;
+    }
+    auto ret = acc_ & ((uint64_t(1) << n) - 1);
+    acc_ >>= n;
+    avail_ -= n;
+    return ret;
+  }
+
+  bool ok() const { return ok_; }
+  void fail() { ok_ = false; }
+
+ private:
+  const char* p_;
+  const char* end_;
+  uint64_t    acc_ = 0;
+  int         avail_ = 0;
+  bool        ok_ = true;
+};
+
+template <typename V>
+constexpr bool is_bit_codable();
+
+template <typename T, size_t... I>
+constexpr bool is_class_bit_codable(index_sequence<I...>) {
+  auto codable = [](auto info) {
+    using V = decltype(info.value);
+    if constexpr (is_member_object_pointer_v<V>)
+      return is_bit_codable<remove_cv_t<member_t<V>>>();
+    return true;
+  };
+  return (codable(get<I>(class_fields_v<T>)) && ...);
+}
+
+// Whether V can be encoded by `encode_bits` and decoded by `decode_bits`.
+template <typename V>
+constexpr bool is_bit_codable() {
+  if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    return true;
+  } else if constexpr (is_std_array<V>::value) {
+    return is_bit_codable<typename V::value_type>();
+  } else if constexpr (is_reflected_v<V>) {
+    return is_class_bit_codable<V>(make_index_sequence<tuple_size_v<decltype(class_fields_v<V>)>>());
+  } else {
+    return false;
+  }
+}
+
+template <typename V>
+constexpr bool is_bit_codable_v = is_bit_codable<V>();
+
+template <typename T>
+constexpr int class_bits();
+
+// Bits of a value of V written with the field meta.
+template <typename V, typename Meta>
+constexpr int value_bits(const Meta& meta) {
+  if constexpr (is_same_v<V, bool>) {
+    return 1;
+  } else if constexpr (is_enum_v<V> && is_reflected_enum_v<V>) {
+    if constexpr (is_enum_flags_v<V>)
+      return bit_width64(enum_flags_mask_v<V>);
+    else
+      return bit_width64(enum_count_v<V> - 1);
+  } else if constexpr (is_integral_v<V> && is_range_meta_v<Meta>) {
+    auto r = as_range_meta(&meta);
+    return bit_width64(uint64_t(int64_t(r->maxV) - int64_t(r->minV)));
+  } else if constexpr (is_floating_point_v<V> && is_convertible_v<Meta, MetaQuantized>) {
+    return static_cast<const MetaQuantized&>(meta).bits;
+  } else if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    // including floating point with MetaRange, use MetaQuantized to save bits.
+    return int(sizeof(V) * 8);
+  } else if constexpr (is_std_array<V>::value) {
+    return int(tuple_size_v<V>) * value_bits<typename V::value_type>(meta);
+  } else {
+    return class_bits<V>();
+  }
+}
+
+template <typename T, size_t... I>
+constexpr int class_bits(index_sequence<I...>) {
+  auto bits = [](auto info) {
+    using V = decltype(info.value);
+    if constexpr (is_member_object_pointer_v<V>)
+      return value_bits<remove_cv_t<member_t<V>>>(info.meta);
+    return 0;
+  };
+  return (0 + ... + bits(get<I>(class_fields_v<T>)));
+}
+
+template <typename T>
+constexpr int class_bits() {
+  return class_bits<T>(make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+}
+
+// Bits written by encode_bits for T, usable to budget the bandwidth.
+template <typename T>
+constexpr int bit_size_v = class_bits<T>();
+
+template <typename V>
+using bits_raw_t = conditional_t<
+    sizeof(V) == 8, uint64_t,
+    conditional_t<sizeof(V) == 4, uint32_t, conditional_t<sizeof(V) == 2, uint16_t, uint8_t>>>;
+
+template <typename T>
+bool encode_bits(BitWriter& w, const T& v);
+
+template <typename T>
+bool decode_bits(BitReader& r, T& v);
+
+// @param Bits: value_bits<V>(meta).
+template <int Bits, typename V, typename Meta>
+bool encode_bits_value(BitWriter& w, const V& v, const Meta& meta) {
+  if constexpr (is_same_v<V, bool>) {
+    w.write(v, 1);
+  } else if constexpr (is_enum_v<V> && is_reflected_enum_v<V>) {
+    if constexpr (is_enum_flags_v<V>) {
+      auto bits = flags_bits(v);
+      if (bits & ~enum_flags_mask_v<V>)
+        return false;
+      w.write(bits, Bits);
+    } else {
+      auto idx = enum_index(v);
+      if (idx < 0)
+        return false;
+      w.write(uint64_t(idx), Bits);
+    }
+  } else if constexpr (is_integral_v<V> && is_range_meta_v<Meta>) {
+    using W = conditional_t<is_signed_v<V>, int64_t, uint64_t>;
+    auto r = as_range_meta(&meta);
+    if (W(v) < W(r->minV) || W(v) > W(r->maxV))
+      return false;
+    w.write(uint64_t(W(v) - W(r->minV)), Bits);
+  } else if constexpr (is_floating_point_v<V> && is_convertible_v<Meta, MetaQuantized>) {
+    static_assert(Bits > 0 && Bits <= 32, "quantized bits should be in [1, 32]");
+    auto& q = static_cast<const MetaQuantized&>(meta);
+    if (!(v >= q.minV && v <= q.maxV))
+      return false;
+    constexpr auto steps = double((uint64_t(1) << Bits) - 1);
+    w.write(uint64_t((v - q.minV) / (q.maxV - q.minV) * steps + 0.5), Bits);
+  } else if constexpr (is_floating_point_v<V> && is_range_meta_v<Meta>) {
+    auto r = as_range_meta(&meta);
+    if (!(v >= r->minV && v <= r->maxV))
+      return false;
+    bits_raw_t<V> u;
+    memcpy(&u, &v, sizeof(v));
+    w.write(u, Bits);
+  } else if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    bits_raw_t<V> u;
+    memcpy(&u, &v, sizeof(v));
+    w.write(u, Bits);
+  } else if constexpr (is_std_array<V>::value) {
+    for (auto& e : v)
+      if (!encode_bits_value<Bits / int(tuple_size_v<V>)>(w, e, meta))
+        return false;
+  } else {
+    return encode_bits(w, v);
+  }
+  return true;
+}
+
+template <int Bits, typename V, typename Meta>
+bool decode_bits_value(BitReader& r, V& v, const Meta& meta) {
+  if constexpr (is_same_v<V, bool>) {
+    v = r.read(1);
+  } else if constexpr (is_enum_v<V> && is_reflected_enum_v<V>) {
+    auto bits = r.read(Bits);
+    if constexpr (is_enum_flags_v<V>) {
+      if (bits & ~enum_flags_mask_v<V>)
+        return false;
+      v = static_cast<V>(bits);
+    } else {
+      if (bits >= enum_count_v<V>)
+        return false;
+      v = enum_info_v<V>.items[bits].value;
+    }
+  } else if constexpr (is_integral_v<V> && is_range_meta_v<Meta>) {
+    using W = conditional_t<is_signed_v<V>, int64_t, uint64_t>;
+    auto rg = as_range_meta(&meta);
+    auto x = W(W(rg->minV) + W(r.read(Bits)));
+    if (x > W(rg->maxV))
+      return false;
+    v = V(x);
+  } else if constexpr (is_floating_point_v<V> && is_convertible_v<Meta, MetaQuantized>) {
+    auto&          q = static_cast<const MetaQuantized&>(meta);
+    constexpr auto steps = double((uint64_t(1) << Bits) - 1);
+    v = V(q.minV + double(r.read(Bits)) * (q.maxV - q.minV) / steps);
+  } else if constexpr (is_floating_point_v<V> && is_range_meta_v<Meta>) {
+    auto rg = as_range_meta(&meta);
+    auto u = bits_raw_t<V>(r.read(Bits));
+    memcpy(&v, &u, sizeof(v));
+    if (!(v >= rg->minV && v <= rg->maxV))
+      return false;
+  } else if constexpr (is_arithmetic_v<V> || is_enum_v<V>) {
+    auto u = bits_raw_t<V>(r.read(Bits));
+    memcpy(&v, &u, sizeof(v));
+  } else if constexpr (is_std_array<V>::value) {
+    for (auto& e : v)
+      if (!decode_bits_value<Bits / int(tuple_size_v<V>)>(r, e, meta))
+        return false;
+  } else {
+    return decode_bits(r, v);
+  }
+  return r.ok();
+}
+
+template <typename T, size_t I>
+bool encode_bits_field(BitWriter& w, const T& v) {
+  constexpr auto info = get<I>(class_fields_v<T>);
+  using V = decltype(info.value);
+  if constexpr (is_member_object_pointer_v<V>) {
+    constexpr int bits = value_bits<remove_cv_t<member_t<V>>>(info.meta);
+    return encode_bits_value<bits>(w, v.*(info.value), info.meta);
+  } else {
+    return true;
+  }
+}
+
+template <typename T, size_t I>
+bool decode_bits_field(BitReader& r, T& v) {
+  constexpr auto info = get<I>(class_fields_v<T>);
+  using V = decltype(info.value);
+  if constexpr (is_member_object_pointer_v<V>) {
+    constexpr int bits = value_bits<remove_cv_t<member_t<V>>>(info.meta);
+    return decode_bits_value<bits>(r, v.*(info.value), info.meta);
+  } else {
+    return true;
+  }
+}
+
+template <typename T, size_t... I>
+bool encode_bits_fields(BitWriter& w, const T& v, index_sequence<I...>) {
+  return (encode_bits_field<T, I>(w, v) && ...);
+}
+
+template <typename T, size_t... I>
+bool decode_bits_fields(BitReader& r, T& v, index_sequence<I...>) {
+  return (decode_bits_field<T, I>(r, v) && ...);
+}
+
+// Pack the data members of a reflected class by their meta, see above.
+// @return: false if a value is out of the range of its meta or not an item of
+// its enum, the written bits are unusable then.
+template <typename T>
+bool encode_bits(BitWriter& w, const T& v) {
+  static_assert(is_bit_codable_v<T> && is_reflected_v<T>, "type not supported by bit packing");
+  return encode_bits_fields(w, v, make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+}
+
+// @return: false if truncated or a value is out of the range of its meta.
+template <typename T>
+bool decode_bits(BitReader& r, T& v) {
+  static_assert(is_bit_codable_v<T> && is_reflected_v<T>, "type not supported by bit packing");
+  return decode_bits_fields(r, v, make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// batch validation
+///
+//////////////////////////////////////////////////////////////////////////
+
+// Rows failing the constraint of one field.
+struct FieldFailures {
+  Name             name;
+  int              index = 0;  // index in class_fields_v<T>
+  vector<uint32_t> rows;       // ascending
+};
+
+struct ValidateResult {
+  vector<uint64_t>      failed;  // one bit per row, set if any field failed
+  vector<FieldFailures> fields;  // one per constrained field, in field order
+
+  bool row_failed(size_t row) const { return failed[row / 64] >> (row % 64) & 1; }
+
+  bool ok() const {
+    for (auto w : failed)
+      if (w)
+        return false;
+    return true;
+  }
+};
+
+// Bounds of the range meta of a field of type M, compared in a type wide
+// enough for both.
+template <typename M, typename Meta>
+constexpr auto range_bounds(const Meta& meta) {
+  if constexpr (is_convertible_v<Meta, MetaQuantized>) {
+    auto& q = static_cast<const MetaQuantized&>(meta);
+    return pair<double, double>{q.minV, q.maxV};
+  } else {
+    auto r = as_range_meta(&meta);
+    using X = remove_cv_t<remove_reference_t<decltype(r->minV)>>;
+    using W = conditional_t<is_floating_point_v<M> || is_floating_point_v<X>, double,
+                            conditional_t<is_signed_v<M>, int64_t, uint64_t>>;
+    if constexpr (is_unsigned_v<W> && is_signed_v<X>) {
+      if (r->maxV < 0)
+        return pair<W, W>{1, 0};  // nothing passes
+      return pair<W, W>{r->minV < 0 ? 0 : W(r->minV), W(r->maxV)};
+    } else {
+      return pair<W, W>{W(r->minV), W(r->maxV)};
+    }
+  }
+}
+
+template <typename M, typename Meta>
+constexpr bool is_constrained_v =
+    is_arithmetic_v<M> && !is_same_v<M, bool> &&
+    (is_range_meta_v<Meta> || (is_floating_point_v<M> && is_convertible_v<Meta, MetaQuantized>));
+
+template <typename T, size_t I>
+constexpr bool is_constrained_field() {
+  constexpr auto info = get<I>(class_fields_v<T>);
+  using V = decltype(info.value);
+  if constexpr (is_member_object_pointer_v<V>)
+    return is_constrained_v<remove_cv_t<member_t<V>>, remove_cv_t<decltype(info.meta)>>;
+  else
+    return false;
+}
+
+// True if field I of the row fails its constraint, false for other fields.
+template <typename T, size_t I>
+bool field_fails(const T& row) {
+  if constexpr (is_constrained_field<T, I>()) {
+    constexpr auto info = get<I>(class_fields_v<T>);
+    using M = remove_cv_t<member_t<decltype(info.value)>>;
+    constexpr auto bounds = range_bounds<M>(info.meta);
+    decltype(bounds.first) v = row.*(info.value);
+    return !((v >= bounds.first) & (v <= bounds.second));
+  } else {
+    return false;
+  }
+}
+
+// Add the rows of the block failing field I, among the failed rows in mask.
+template <typename T, size_t I>
+void validate_block(const T* rows, size_t begin, uint64_t mask, ValidateResult& res,
+                    size_t& slot) {
+  if constexpr (is_constrained_field<T, I>()) {
+    auto& out = res.fields[slot++];
+    for (; mask; mask &= mask - 1) {
+      auto row = begin + countr_zero64(mask);
+      if (field_fails<T, I>(rows[row]))
+        out.rows.push_back(uint32_t(row));
+    }
+  }
+}
+
+// Rows are checked one by one in blocks of 64, all fields of a row at once;
+// only the failed rows are checked again to list the failures of each field.
+// NOTE: this is a plain row loop running at the speed of an each_field loop
+// over the rows, see validate_columns for the vectorized checks.
+template <typename T, size_t... I>
+void validate_fields(const T* rows, size_t count, ValidateResult& res, index_sequence<I...>) {
+  auto add = [&](auto info, int index, bool constrained) {
+    if (constrained)
+      res.fields.push_back({info.name, index, {}});
+  };
+  (add(get<I>(class_fields_v<T>), int(I), is_constrained_field<T, I>()), ...);
+
+  for (size_t b = 0; b < count; b += 64) {
+    auto     n = min<size_t>(64, count - b);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; i++)
+      if ((field_fails<T, I>(rows[b + i]) || ...))
+        mask |= uint64_t(1) << i;
+    if (!mask)
+      continue;
+    res.failed[b / 64] = mask;
+    size_t slot = 0;
+    (validate_block<T, I>(rows, b, mask, res, slot), ...);
+  }
+}
+
+// Check the data members having MetaRange meta, or MetaQuantized meta for
+// floating points, of every row of the batch. NaN fails.
+// NOTE: members of nested classes and arrays are not checked.
+template <typename T>
+ValidateResult validate(const T* rows, size_t count) {
+  static_assert(is_reflected_v<T>, "only reflected classes can be validated");
+  ValidateResult res;
+  res.failed.resize((count + 63) / 64);
+  validate_fields(rows, count, res,
+                  make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+  return res;
+}
+
+// @param rows: contiguous container, e.g. vector or span.
+template <typename C>
+auto validate(const C& rows) -> decltype(validate(rows.data(), rows.size())) {
+  return validate(rows.data(), rows.size());
+}
+
+// Bounds of range_bounds in the type of the values, so that the compares of
+// a column stay as narrow as its elements. None passes if first > second.
+template <typename M, typename W>
+auto column_bounds(pair<W, W> b) {
+  if constexpr (is_integral_v<M> && is_integral_v<W> && !is_same_v<M, W>) {
+    constexpr auto lo = W(numeric_limits<M>::min()), hi = W(numeric_limits<M>::max());
+    if (b.first > hi || b.second < lo || b.first > b.second)
+      return pair<M, M>{1, 0};
+    return pair<M, M>{M(max(b.first, lo)), M(min(b.second, hi))};
+  } else if constexpr (is_same_v<M, float> && is_same_v<W, double>) {
+    // the nearest floats inside the range, infinities and NaN still fail.
+    constexpr auto fmax = double(numeric_limits<float>::max());
+    constexpr auto inf = numeric_limits<float>::infinity();
+    auto lo = b.first < -fmax ? -float(fmax) : b.first > fmax ? inf : float(b.first);
+    auto hi = b.second > fmax ? float(fmax) : b.second < -fmax ? -inf : float(b.second);
+    if (double(lo) < b.first)
+      lo = nextafter(lo, inf);
+    if (double(hi) > b.second)
+      hi = nextafter(hi, -inf);
+    return pair<M, M>{lo, hi};
+  } else {
+    return b;
+  }
+}
+
+// One bit per value of the block out of the bounds.
+template <size_t N, typename V, typename B>
+uint64_t column_fail_mask(const V* block, size_t n, B bounds) {
+  // a branchless pass over the block first, vectorized by the compilers.
+  uint8_t any = 0;
+  for (size_t i = 0; i < (N ? N : n); i++)
+    any |= !((block[i] >= bounds.first) & (block[i] <= bounds.second));
+  if (!any)
+    return 0;
+  uint64_t mask = 0;
+  for (size_t i = 0; i < n; i++)
+    if (!((block[i] >= bounds.first) & (block[i] <= bounds.second)))
+      mask |= uint64_t(1) << i;
+  return mask;
+}
+
+template <typename T, size_t I>
+void validate_column(const columns_t<T>& cols, ValidateResult& res, size_t& slot) {
+  if constexpr (is_constrained_field<T, I>()) {
+    constexpr auto info = get<I>(class_fields_v<T>);
+    using M = remove_cv_t<member_t<decltype(info.value)>>;
+    auto  bounds = column_bounds<M>(range_bounds<M>(info.meta));
+    auto& col = get<I>(cols);
+    auto& out = res.fields[slot++];
+    for (size_t b = 0; b < col.size(); b += 64) {
+      auto n = min<size_t>(64, col.size() - b);
+      auto mask = n == 64 ? column_fail_mask<64>(col.data() + b, n, bounds)
+                          : column_fail_mask<0>(col.data() + b, n, bounds);
+      res.failed[b / 64] |= mask;
+      for (; mask; mask &= mask - 1)
+        out.rows.push_back(uint32_t(b + countr_zero64(mask)));
+    }
+  }
+}
+
+template <typename T, size_t... I>
+ValidateResult validate_columns(const columns_t<T>& cols, index_sequence<I...>) {
+  ValidateResult res;
+  size_t         count = 0;
+  auto           add = [&](auto info, int index, bool constrained, auto& col) {
+    if constexpr (!is_same_v<decay_t<decltype(col)>, tuple<>>)
+      count = col.size();
+    if (constrained)
+      res.fields.push_back({info.name, index, {}});
+  };
+  (add(get<I>(class_fields_v<T>), int(I), is_constrained_field<T, I>(), get<I>(cols)), ...);
+  res.failed.resize((count + 63) / 64);
+
+  size_t slot = 0;
+  (validate_column<T, I>(cols, res, slot), ...);
+  return res;
+}
+
+// Same as validate but over the columns of load_csv_columns, one contiguous
+// column at a time, so that the range checks are vectorized.
+// NOTE: all the columns must have the same size.
+template <typename T>
+ValidateResult validate_columns(const columns_t<T>& cols) {
+  static_assert(is_reflected_v<T>, "only reflected classes can be validated");
+  return validate_columns<T>(cols, make_index_sequence<tuple_size_v<columns_t<T>>>());
+}
+
+}  // namespace imp
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// public APIs
+///
+//////////////////////////////////////////////////////////////////////////
+
+using imp::BatchOptions;
+using imp::BitReader;
+using imp::bit_size_v;
+using imp::BitWriter;
+using imp::ByteReader;
+using imp::ByteWriter;
+using imp::columns_t;
+using imp::CsvOptions;
+using imp::CsvResult;
+using imp::decode;
+using imp::decode_batch;
+using imp::decode_bits;
+using imp::encode;
+using imp::encode_batch;
+using imp::encode_bits;
+using imp::FieldFailures;
+using imp::is_bit_codable_v;
+using imp::is_codable_v;
+using imp::load_csv;
+using imp::load_csv_columns;
+using imp::load_csv_columns_file;
+using imp::load_csv_file;
+using imp::MappedFile;
+using imp::MetaQuantized;
+using imp::MetaRange;
+using imp::parse_text;
+using imp::validate;
+using imp::validate_columns;
+using imp::ValidateResult;
+
+}  // namespace tref
+
+#endif
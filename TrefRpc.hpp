@@ -0,0 +1,489 @@
+// Tref rpc: invoke reflected methods with encoded arguments, built on top of
+// TrefData.hpp.
+
+/***********************************************************************
+Copyright 2019-2020 crazybie<soniced@sina.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TREF_RPC_H
+#define TREF_RPC_H
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "TrefData.hpp"
+
+namespace tref {
+namespace imp {
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// profiling of methods called by the reflected invocation path
+///
+//////////////////////////////////////////////////////////////////////////
+
+// Define it as 1 to profile methods with MetaProfiled, when it is 0 the
+// meta is ignored: nothing is recorded and the call path is unchanged.
+#ifndef TrefProfiling
+#define TrefProfiling 0
+#endif
+
+// Field meta of methods to be profiled, combine it with other metas by
+// Metas<...>.
+struct MetaProfiled {};
+
+#if TrefProfiling
+
+// Bucket i counts calls taking [2^(i-1), 2^i) ns, bucket 0 counts 0 ns.
+constexpr int ProfileBuckets = 48;
+
+inline int profile_bucket(uint64_t ns) {
+#if defined(__GNUC__) || defined(__clang__)
+  int bits = ns ? 64 - __builtin_clzll(ns) : 0;
+#else
+  int bits = 0;
+  for (; ns; ns >>= 1)
+    bits++;
+#endif
+  return bits < ProfileBuckets ? bits : ProfileBuckets - 1;
+}
+
+// Counters of one method in one thread: only written by the owning thread,
+// read by the aggregating thread without locks.
+struct ProfileSlot {
+  atomic<uint64_t> count{0};
+  atomic<uint64_t> total_ns{0};
+  atomic<uint64_t> hist[ProfileBuckets]{};
+  ProfileSlot*     next = nullptr;
+
+  void record(uint64_t ns) {
+    auto add = [](atomic<uint64_t>& a, uint64_t v) {
+      a.store(a.load(memory_order_relaxed) + v, memory_order_relaxed);
+    };
+    add(count, 1);
+    add(total_ns, ns);
+    add(hist[profile_bucket(ns)], 1);
+  }
+};
+
+struct MethodProfile {
+  Name                 class_name;
+  Name                 method_name;
+  atomic<ProfileSlot*> slots{nullptr};
+  MethodProfile*       next = nullptr;
+};
+
+inline atomic<MethodProfile*> method_profiles{nullptr};
+
+template <typename N>
+void push_lock_free(atomic<N*>& head, N* n) {
+  n->next = head.load(memory_order_relaxed);
+  while (!head.compare_exchange_weak(n->next, n, memory_order_release, memory_order_relaxed)) {
+  }
+}
+
+template <typename T, size_t I>
+MethodProfile& method_profile() {
+  static MethodProfile* p = [] {
+    auto ret = new MethodProfile{class_info_v<T>.name, get<I>(class_fields_v<T>).name};
+    push_lock_free(method_profiles, ret);
+    return ret;
+  }();
+  return *p;
+}
+
+// NOTE: slots of exited threads are kept for the aggregation.
+template <typename T, size_t I>
+ProfileSlot& profile_slot() {
+  thread_local ProfileSlot* slot = [] {
+    auto ret = new ProfileSlot;
+    push_lock_free(method_profile<T, I>().slots, ret);
+    return ret;
+  }();
+  return *slot;
+}
+
+template <typename T, size_t I>
+struct ProfileTimer {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  ~ProfileTimer() {
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    profile_slot<T, I>().record((uint64_t)ns.count());
+  }
+};
+
+struct ProfileStats {
+  Name     class_name;
+  Name     method_name;
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t hist[ProfileBuckets] = {};
+
+  // Upper bound of the latency of `p` percent of the calls, in ns, from the
+  // bucket of the nearest-rank call.
+  uint64_t percentile(double p) const {
+    if (!count)
+      return 0;
+    auto n = max<uint64_t>(1, uint64_t(ceil(count * p / 100.0)));
+    for (int i = 0; i < ProfileBuckets; i++) {
+      if (hist[i] >= n || i == ProfileBuckets - 1)
+        return i ? uint64_t(1) << i : 0;
+      n -= hist[i];
+    }
+    return 0;
+  }
+};
+
+// Sum up the counters of all threads, one entry for each profiled method
+// called at least once.
+inline void profile_snapshot(vector<ProfileStats>& out) {
+  out.clear();
+  for (auto m = method_profiles.load(memory_order_acquire); m; m = m->next) {
+    auto& s = out.emplace_back();
+    s.class_name = m->class_name;
+    s.method_name = m->method_name;
+    for (auto slot = m->slots.load(memory_order_acquire); slot; slot = slot->next) {
+      s.count += slot->count.load(memory_order_relaxed);
+      s.total_ns += slot->total_ns.load(memory_order_relaxed);
+      for (int i = 0; i < ProfileBuckets; i++)
+        s.hist[i] += slot->hist[i].load(memory_order_relaxed);
+    }
+  }
+}
+
+// Call `tick` periodically to get the statistics since the previous tick.
+class ProfileAggregator {
+ public:
+  void tick(vector<ProfileStats>& delta) {
+    profile_snapshot(delta);
+    for (auto& d : delta) {
+      auto cur = d;
+      for (auto& p : last_) {
+        if (p.class_name == d.class_name && p.method_name == d.method_name) {
+          d.count -= p.count;
+          d.total_ns -= p.total_ns;
+          for (int i = 0; i < ProfileBuckets; i++)
+            d.hist[i] -= p.hist[i];
+          break;
+        }
+      }
+      updated_.push_back(cur);
+    }
+    last_.swap(updated_);
+    updated_.clear();
+  }
+
+ private:
+  vector<ProfileStats> last_, updated_;
+};
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// method invocation thunks
+///
+//////////////////////////////////////////////////////////////////////////
+
+template <typename TP>
+struct decay_tuple;
+template <typename... A>
+struct decay_tuple<tuple<A...>> {
+  using type = tuple<decay_t<A>...>;
+};
+
+// Argument values of a function, as decoded from the buffer.
+template <typename F>
+using decayed_args_t = typename decay_tuple<typename func_trait<F>::args_t>::type;
+
+template <typename F>
+constexpr bool is_rpc_callable() {
+  if constexpr (is_member_function_pointer_v<F> ||
+                (is_pointer_v<F> && is_function_v<remove_pointer_t<F>>)) {
+    using R = decay_t<typename func_trait<F>::ret_t>;
+    return is_codable_v<decayed_args_t<F>> && (is_void_v<R> || is_codable_v<R>);
+  } else {
+    return false;
+  }
+}
+
+// Decode the arguments, call the I-th field of T, then encode the result.
+// @return: false if the arguments are invalid, including trailing bytes in
+// `in`, the method is not called in this case.
+// Hookable methods are called through their hook chains.
+template <typename T, size_t I>
+bool method_thunk(T& obj, ByteReader& in, ByteWriter& out) {
+  constexpr auto info = get<I>(class_fields_v<T>);
+  constexpr auto f = info.value;
+  using F = remove_const_t<decltype(f)>;
+
+  decayed_args_t<F> args{};
+  if (!decode(in, args) || in.remaining())
+    return false;
+
+  // called through a variable of its own type, GCC reads the constexpr one
+  // through a type-punned pointer.
+  F    method = f;
+  auto call = [&](auto&... a) -> decltype(auto) {
+#if TrefProfiling
+    conditional_t<is_base_of_v<MetaProfiled, decltype(info.meta)>, ProfileTimer<T, I>, tuple<>>
+        timer;
+    (void)timer;
+#endif
+    if constexpr (is_base_of_v<MetaHookableBase, decltype(info.meta)>)
+      return info.meta.chain()(obj, a...);
+    else if constexpr (is_member_function_pointer_v<F>)
+      return (obj.*method)(a...);
+    else
+      return f(a...);
+  };
+  if constexpr (is_void_v<typename func_trait<F>::ret_t>) {
+    apply(call, args);
+  } else {
+    encode(out, apply(call, args));
+  }
+  return true;
+}
+
+template <typename T>
+using MethodThunk = bool (*)(T&, ByteReader&, ByteWriter&);
+
+template <typename T, size_t I>
+constexpr MethodThunk<T> method_thunk_of() {
+  if constexpr (is_rpc_callable<remove_const_t<decltype(get<I>(class_fields_v<T>).value)>>())
+    return &method_thunk<T, I>;
+  return nullptr;
+}
+
+template <typename T, size_t... I>
+constexpr auto method_thunks(index_sequence<I...>) {
+  return array<MethodThunk<T>, sizeof...(I)>{method_thunk_of<T, I>()...};
+}
+
+// Thunks indexed by the field index of `class_fields_v<T>`, nullptr for
+// fields that are not methods or with arguments can not be decoded.
+template <typename T>
+constexpr auto method_thunks_v =
+    method_thunks<T>(make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+
+// @return: false if the method is not found or the arguments are invalid,
+// `in` must hold exactly the arguments.
+template <typename T>
+bool invoke_method(T& obj, int fieldIndex, ByteReader& in, ByteWriter& out) {
+  constexpr auto& thunks = method_thunks_v<T>;
+  if (fieldIndex < 0 || size_t(fieldIndex) >= thunks.size() || !thunks[fieldIndex])
+    return false;
+  return thunks[fieldIndex](obj, in, out);
+}
+
+template <typename T>
+bool invoke_method(T& obj, string_view name, ByteReader& in, ByteWriter& out) {
+  return invoke_method(obj, class_info_v<T>.get_field_index(name), in, out);
+}
+
+template <typename TP, typename... A, size_t... I>
+void encode_args_imp(ByteWriter& w, index_sequence<I...>, A&&... a) {
+  (encode(w, tuple_element_t<I, TP>(std::forward<A>(a))), ...);
+}
+
+// Encode arguments for the method F, converted to its parameter types.
+template <auto F, typename... A>
+void encode_args(ByteWriter& w, A&&... a) {
+  using Args = decayed_args_t<decltype(F)>;
+  static_assert(tuple_size_v<Args> == sizeof...(A), "wrong count of arguments");
+  encode_args_imp<Args>(w, index_sequence_for<A...>(), std::forward<A>(a)...);
+}
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// method-id router
+///
+/// Batch of calls: repeated [uint16 method id][uint32 args size][args].
+/// Batch of results: repeated [uint8 ok][uint32 result size][result].
+///
+//////////////////////////////////////////////////////////////////////////
+
+// Whether the I-th field of T is exported by RpcRouter<T, Tag>.
+// Tag = void to export all callable methods.
+template <typename T, typename Tag, size_t I>
+constexpr bool is_routed() {
+  constexpr auto info = get<I>(class_fields_v<T>);
+  if constexpr (!is_rpc_callable<remove_const_t<decltype(info.value)>>())
+    return false;
+  else if constexpr (is_void_v<Tag>)
+    return true;
+  else
+    return is_convertible_v<decltype(info.meta), Tag>;
+}
+
+template <typename T, typename Tag, size_t... I>
+constexpr auto routed_fields(index_sequence<I...>) {
+  constexpr bool   routed[] = {false, is_routed<T, Tag, I>()...};
+  constexpr size_t cnt = (0 + ... + (size_t)is_routed<T, Tag, I>());
+  array<int, cnt>  ret{};
+  size_t           n = 0;
+  for (size_t i = 0; i < sizeof...(I); i++)
+    if (routed[i + 1])
+      ret[n++] = (int)i;
+  return ret;
+}
+
+// Assign compact ids to the exported methods of T in field order, then
+// decode & run pipelined calls back-to-back without allocations.
+template <typename T, typename Tag = void>
+struct RpcRouter {
+  // Field index of each method id.
+  static constexpr auto fields =
+      routed_fields<T, Tag>(make_index_sequence<tuple_size_v<decltype(class_fields_v<T>)>>());
+  static constexpr auto size = fields.size();
+
+  static constexpr auto thunks = [] {
+    array<MethodThunk<T>, size> ret{};
+    for (size_t i = 0; i < size; i++)
+      ret[i] = method_thunks_v<T>[fields[i]];
+    return ret;
+  }();
+
+  // @return: -1 if not exported.
+  static constexpr int method_id(string_view name) {
+    auto idx = class_info_v<T>.get_field_index(name);
+    for (size_t i = 0; i < size; i++)
+      if (fields[i] == idx)
+        return (int)i;
+    return -1;
+  }
+
+  // @return: empty name if `id` is out of range.
+  static constexpr Name method_name(int id) {
+    Name ret;
+    if (id < 0 || size_t(id) >= size)
+      return ret;
+    int idx = 0;
+    tuple_for_each(class_fields_v<T>, [&](auto info) {
+      if (idx++ == fields[id]) {
+        ret = info.name;
+        return false;
+      }
+      return true;
+    });
+    return ret;
+  }
+
+  // @return: -1 if F is not exported.
+  template <auto F>
+  static constexpr int method_id_of() {
+    int ret = -1, idx = 0;
+    tuple_for_each(class_fields_v<T>, [&](auto info) {
+      if constexpr (is_same_v<remove_const_t<decltype(info.value)>, decltype(F)>) {
+        if (info.value == F) {
+          for (size_t i = 0; i < size; i++)
+            if (fields[i] == idx)
+              ret = (int)i;
+        }
+      }
+      idx++;
+      return ret < 0;
+    });
+    return ret;
+  }
+
+  // Append a call of method F to the batch.
+  template <auto F, typename... A>
+  static void encode_call(ByteWriter& w, A&&... a) {
+    constexpr auto id = method_id_of<F>();
+    static_assert(id >= 0, "method is not exported");
+
+    w.write_raw((uint16_t)id);
+    auto sizePos = w.skip(sizeof(uint32_t));
+    encode_args<F>(w, std::forward<A>(a)...);
+    w.patch(sizePos, uint32_t(w.size() - sizePos - sizeof(uint32_t)));
+  }
+
+  // Run all calls in the batch, append one result for each call.
+  // @return: count of calls, -1 if the batch is malformed.
+  static int dispatch(T& obj, string_view batch, ByteWriter& results) {
+    ByteReader in(batch);
+    int        calls = 0;
+    while (in.remaining()) {
+      uint16_t id;
+      uint32_t argsSize;
+      if (!in.read_raw(id) || !in.read_raw(argsSize) || argsSize > in.remaining())
+        return -1;
+      ByteReader args(in.view(argsSize));
+
+      // the thunk validates the whole frame before calling the method, a call
+      // with trailing bytes fails without side effects.
+      auto okPos = results.skip(sizeof(uint8_t) + sizeof(uint32_t));
+      auto ok = id < size && thunks[id](obj, args, results);
+      results.patch(okPos, (uint8_t)ok);
+      results.patch(okPos + 1, uint32_t(results.size() - okPos - 5));
+      calls++;
+    }
+    return calls;
+  }
+
+  // Read the next result of a batch.
+  // @return: false if the call failed or no more results.
+  template <typename R>
+  static bool decode_result(ByteReader& results, R& ret) {
+    uint8_t  ok = 0;
+    uint32_t n = 0;
+    if (!results.read_raw(ok) || !results.read_raw(n))
+      return false;
+    ByteReader r(results.view(n));
+    return ok && results.ok() && decode(r, ret);
+  }
+
+  static bool decode_result(ByteReader& results) {
+    uint8_t  ok = 0;
+    uint32_t n = 0;
+    if (!results.read_raw(ok) || !results.read_raw(n))
+      return false;
+    results.view(n);
+    return ok && results.ok();
+  }
+};
+
+}  // namespace imp
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// public APIs
+///
+//////////////////////////////////////////////////////////////////////////
+
+using imp::encode_args;
+using imp::invoke_method;
+using imp::MetaProfiled;
+using imp::method_thunks_v;
+using imp::MethodThunk;
+using imp::RpcRouter;
+
+#if TrefProfiling
+using imp::profile_snapshot;
+using imp::ProfileAggregator;
+using imp::ProfileStats;
+#endif
+
+}  // namespace tref
+
+#endif
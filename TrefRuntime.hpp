@@ -0,0 +1,465 @@
+// Tref runtime: type-erased reflection registry for scripting & tools, built
+// on top of Tref.hpp.
+
+/***********************************************************************
+Copyright 2019-2020 crazybie<soniced@sina.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TREF_RUNTIME_H
+#define TREF_RUNTIME_H
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "Tref.hpp"
+
+// Slots of each lookup table, must be a power of 2. Registering more classes
+// than this fails.
+#ifndef TrefRuntimeCapacity
+#define TrefRuntimeCapacity 1024
+#endif
+
+namespace tref {
+namespace imp {
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// runtime descriptors
+///
+//////////////////////////////////////////////////////////////////////////
+
+enum class RtFieldKind : uint8_t { Data, StaticData, Method, StaticMethod };
+
+struct RtClass;
+
+const RtClass* find_class(const void* type);
+
+struct RtField {
+  Name        name;
+  RtFieldKind kind = RtFieldKind::Data;
+  // Offset in the object for Data.
+  size_t offset = 0;
+  // Size of the value for Data & StaticData.
+  size_t size = 0;
+  // type_id of the value for Data & StaticData, of the pointer otherwise.
+  const void* type = nullptr;
+  // Address of StaticData, StaticMethod.
+  const void* address = nullptr;
+  const void* meta = nullptr;
+  const void* meta_type = nullptr;
+
+  // @return: null if the value type is not a registered class.
+  const RtClass* type_class() const { return find_class(type); }
+
+  // @return: null if not a variable of type V.
+  template <typename V>
+  V* get(void* obj) const {
+    if (type != type_id<V>())
+      return nullptr;
+    if (kind == RtFieldKind::Data)
+      return (V*)((char*)obj + offset);
+    if (kind == RtFieldKind::StaticData)
+      return (V*)address;
+    return nullptr;
+  }
+
+  // @return: null if the meta is not of type M.
+  template <typename M>
+  const M* get_meta() const {
+    return meta_type == type_id<M>() ? (const M*)meta : nullptr;
+  }
+};
+
+struct RtClass {
+  Name           name;
+  size_t         size = 0;
+  const void*    type = nullptr;
+  const void*    meta = nullptr;
+  const void*    meta_type = nullptr;
+  const RtClass* base = nullptr;
+  // Same order as class_fields_v, fields of base classes first.
+  const RtField* fields = nullptr;
+  int            field_count = 0;
+  // Direct subclasses.
+  const RtClass* const* subclasses = nullptr;
+  int                   subclass_count = 0;
+  // Null if not default constructible.
+  void* (*create)() = nullptr;
+  void (*destroy)(void*) = nullptr;
+
+  const RtField* find_field(string_view n) const {
+    for (int i = 0; i < field_count; i++)
+      if (fields[i].name == n)
+        return &fields[i];
+    return nullptr;
+  }
+
+  bool is_a(const RtClass* c) const {
+    for (auto p = this; p; p = p->base)
+      if (p == c)
+        return true;
+    return false;
+  }
+
+  template <typename M>
+  const M* get_meta() const {
+    return meta_type == type_id<M>() ? (const M*)meta : nullptr;
+  }
+};
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// lock-free lookup tables
+///
+//////////////////////////////////////////////////////////////////////////
+
+static_assert((TrefRuntimeCapacity & (TrefRuntimeCapacity - 1)) == 0,
+              "TrefRuntimeCapacity must be a power of 2");
+
+inline atomic<const RtClass*> rt_classes_by_name[TrefRuntimeCapacity];
+inline atomic<const RtClass*> rt_classes_by_type[TrefRuntimeCapacity];
+
+constexpr size_t rt_hash(string_view s) {
+  uint64_t h = 14695981039346656037ull;
+  for (auto c : s)
+    h = (h ^ (uint8_t)c) * 1099511628211ull;
+  return (size_t)h;
+}
+
+#if TrefHashNames
+inline size_t rt_hash(HashedName n) {
+  return size_t(n.hash * 0x9E3779B97F4A7C15ull);
+}
+#endif
+
+inline size_t rt_hash(const void* p) {
+  return size_t(((uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ull) >> 20);
+}
+
+// Insert by CAS, the first registered class wins if the key exists.
+// @return: false if the table is full.
+template <typename K, typename Key>
+bool rt_insert(atomic<const RtClass*>* table, const RtClass* c, K key, Key&& keyOf) {
+  auto h = rt_hash(key);
+  for (size_t i = 0; i < TrefRuntimeCapacity; i++) {
+    auto&          slot = table[(h + i) & (TrefRuntimeCapacity - 1)];
+    const RtClass* cur = nullptr;
+    if (slot.compare_exchange_strong(cur, c, memory_order_acq_rel, memory_order_acquire))
+      return true;
+    if (keyOf(cur) == key)
+      return true;
+  }
+  return false;
+}
+
+template <typename K, typename Key>
+const RtClass* rt_find(atomic<const RtClass*>* table, K key, Key&& keyOf) {
+  auto h = rt_hash(key);
+  for (size_t i = 0; i < TrefRuntimeCapacity; i++) {
+    auto c = table[(h + i) & (TrefRuntimeCapacity - 1)].load(memory_order_acquire);
+    if (!c || keyOf(c) == key)
+      return c;
+  }
+  return nullptr;
+}
+
+// NOTE: different instances of a class template share the same name, find
+// them by type instead.
+inline const RtClass* find_class(string_view name) {
+  return rt_find(rt_classes_by_name, Name(name), [](const RtClass* c) { return c->name; });
+}
+
+inline const RtClass* find_class(const void* type) {
+  return type ? rt_find(rt_classes_by_type, type, [](const RtClass* c) { return c->type; })
+              : nullptr;
+}
+
+inline const RtClass* find_class(const char* name) {
+  return find_class(string_view(name));
+}
+
+// @param f: [](const RtClass* c) -> bool, return false to stop the iterating.
+template <typename F>
+bool each_class(F&& f) {
+  for (auto& slot : rt_classes_by_type) {
+    auto c = slot.load(memory_order_acquire);
+    if (c && !f(c))
+      return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// registration
+///
+//////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename Info>
+void fill_rt_field(RtField& f, const Info& info) {
+  using V = decltype(info.value);
+  f.name = info.name;
+  f.meta = &info.meta;
+  f.meta_type = type_id<decltype(info.meta)>();
+  if constexpr (is_member_object_pointer_v<V>) {
+    f.kind = RtFieldKind::Data;
+    f.offset = member_offset(static_cast<member_t<V> T::*>(info.value));
+    f.size = sizeof(member_t<V>);
+    f.type = type_id<member_t<V>>();
+  } else if constexpr (is_member_function_pointer_v<V>) {
+    f.kind = RtFieldKind::Method;
+    f.type = type_id<V>();
+  } else if constexpr (is_pointer_v<V> && is_function_v<remove_pointer_t<V>>) {
+    f.kind = RtFieldKind::StaticMethod;
+    f.type = type_id<V>();
+    f.address = (const void*)info.value;
+  } else if constexpr (is_pointer_v<V>) {
+    f.kind = RtFieldKind::StaticData;
+    f.size = sizeof(*info.value);
+    f.type = type_id<remove_pointer_t<V>>();
+    f.address = info.value;
+  }
+}
+
+// Descriptors of one class, the initialization never touches other classes
+// so it can not recurse.
+template <typename T>
+struct RtClassStorage {
+  static constexpr auto fieldCnt = tuple_size_v<decltype(class_fields_v<T>)>;
+  static constexpr auto subCnt = tuple_size_v<decltype(all_slots_data<T, SubclassTag>())>;
+
+  RtClass        cls;
+  RtField        fields[fieldCnt ? fieldCnt : 1];
+  const RtClass* subclasses[subCnt ? subCnt : 1] = {};
+
+  RtClassStorage() {
+    constexpr auto& info = class_info_v<T>;
+    cls.name = info.name;
+    cls.size = info.size;
+    cls.type = type_id<T>();
+    cls.meta = &info.meta;
+    cls.meta_type = type_id<decltype(info.meta)>();
+    cls.fields = fields;
+    cls.field_count = (int)fieldCnt;
+    cls.subclasses = subclasses;
+    cls.subclass_count = (int)subCnt;
+    if constexpr (is_default_constructible_v<T> && !is_abstract_v<T>) {
+      cls.create = [] { return (void*)new T(); };
+      cls.destroy = [](void* p) { delete (T*)p; };
+    }
+
+    auto i = 0;
+    tuple_for_each(class_fields_v<T>, [&](const auto& f) {
+      fill_rt_field<T>(fields[i++], f);
+      return true;
+    });
+  }
+};
+
+template <typename T>
+RtClassStorage<T>& rt_storage() {
+  static RtClassStorage<T> s;
+  return s;
+}
+
+template <typename T>
+constexpr auto root_class() {
+  if constexpr (has_base_class_v<T>)
+    return root_class<typename decltype(class_info_v<T>)::base_t>();
+  else
+    return Type<T>{};
+}
+
+template <typename T>
+void link_rt_class() {
+  auto& s = rt_storage<T>();
+  if constexpr (has_base_class_v<T>)
+    s.cls.base = &rt_storage<typename decltype(class_info_v<T>)::base_t>().cls;
+
+  auto i = 0;
+  tuple_for_each(all_slots_data<T, SubclassTag>(), [&](auto sub) {
+    s.subclasses[i++] = &rt_storage<typename decltype(sub)::type>().cls;
+    return true;
+  });
+}
+
+// Make a linked class visible to the lookups.
+// @return: false if a lookup table is full.
+template <typename T>
+bool publish_rt_class() {
+  auto& s = rt_storage<T>();
+  auto  byName =
+      rt_insert(rt_classes_by_name, &s.cls, s.cls.name, [](const RtClass* c) { return c->name; });
+  auto byType =
+      rt_insert(rt_classes_by_type, &s.cls, s.cls.type, [](const RtClass* c) { return c->type; });
+  return byName && byType;
+}
+
+// Published classes are read without lock, link them once only.
+template <typename T>
+void link_rt_class_once() {
+  static const bool linked = (link_rt_class<T>(), true);
+  (void)linked;
+}
+
+template <typename T>
+bool publish_rt_class_once() {
+  static const bool published = publish_rt_class<T>();
+  return published;
+}
+
+template <typename T>
+using rt_tree_t = decltype(tuple_cat(tuple<Type<typename decltype(root_class<T>())::type>, Type<T>>{},
+                                     class_info_v<typename decltype(root_class<T>())::type>
+                                         .get_subclasses()));
+
+// State of the registration of T, guarded by rt_register_mutex except done.
+template <typename T>
+struct RtRegistration {
+  static inline atomic<bool> done{false};
+  static inline bool         started = false;
+  static inline bool         published = false;
+};
+
+// Serializes registrations, recursive for classes registering the classes
+// of their members.
+inline recursive_mutex& rt_register_mutex() {
+  static recursive_mutex m;
+  return m;
+}
+
+// Registrations started by the outermost register_class, completed by it
+// once every class they reach is linked.
+inline vector<void (*)()>& rt_pending_registrations() {
+  static vector<void (*)()> v;
+  return v;
+}
+
+template <typename T>
+void complete_rt_registration() {
+  using R = RtRegistration<T>;
+  R::published = true;
+  tuple_for_each(rt_tree_t<T>{}, [](auto t) {
+    R::published &= publish_rt_class_once<typename decltype(t)::type>();
+    return true;
+  });
+  R::done.store(true, memory_order_release);
+}
+
+template <typename T>
+const RtClass* register_class();
+
+template <typename T>
+void register_member_classes() {
+  tuple_for_each(class_fields_v<T>, [](auto f) {
+    using V = decltype(f.value);
+    if constexpr (is_member_object_pointer_v<V>) {
+      if constexpr (is_reflected_v<remove_cv_t<member_t<V>>>)
+        register_class<remove_cv_t<member_t<V>>>();
+    }
+    return true;
+  });
+}
+
+// Register T and the whole hierarchy from its root class once, then the
+// classes of their members. Thread safe, registering again just returns
+// the descriptor, other threads wait until the registration is complete.
+// The classes become visible to the lookups all at once, after all of them
+// are linked.
+// @return: null if the lookup tables are full, see TrefRuntimeCapacity.
+//
+// NOTE: must call this function in a template function, like
+// ClassInfo::each_subclass.
+template <typename T>
+const RtClass* register_class() {
+  using R = RtRegistration<T>;
+  if (!R::done.load(memory_order_acquire)) {
+    lock_guard<recursive_mutex> lock(rt_register_mutex());
+    // Members may refer back to T: the nested call on this thread returns
+    // early, the outermost one completes the registration.
+    if (!R::started) {
+      R::started = true;
+      auto& pending = rt_pending_registrations();
+      auto  outermost = pending.empty();
+      pending.push_back(&complete_rt_registration<T>);
+      tuple_for_each(rt_tree_t<T>{}, [](auto t) {
+        link_rt_class_once<typename decltype(t)::type>();
+        return true;
+      });
+      tuple_for_each(rt_tree_t<T>{}, [](auto t) {
+        register_member_classes<typename decltype(t)::type>();
+        return true;
+      });
+      if (outermost) {
+        for (auto complete : pending)
+          complete();
+        pending.clear();
+      }
+    }
+    if (!R::done.load(memory_order_relaxed))
+      return &rt_storage<T>().cls;  // nested, not visible yet
+  }
+  return R::published ? &rt_storage<T>().cls : nullptr;
+}
+
+// Build the runtime descriptors of a class in one translation unit only.
+// Put ZTrefExternClass(T) after T in its header and ZTrefInstantiateClass(T)
+// in one .cpp file, both at global scope. Other units then get the
+// type-erased handle from register_class<T>() or find_class without
+// instantiating the registration of T and its hierarchy. Headers without
+// the macros keep working as before.
+//
+// NOTE: the compile-time reflection (class_info_v, class_fields_v) is still
+// needed by constant evaluation, only the runtime part is shared.
+#define ZTrefExternClass(T)                                                                      \
+  extern template struct tref::imp::RtClassStorage<ZTrefRemoveParen(T)>;                        \
+  extern template tref::imp::RtClassStorage<ZTrefRemoveParen(T)>&                                \
+  tref::imp::rt_storage<ZTrefRemoveParen(T)>();                                                  \
+  extern template const tref::imp::RtClass* tref::imp::register_class<ZTrefRemoveParen(T)>()
+
+// NOTE: put it after all the subclasses of T are reflected.
+#define ZTrefInstantiateClass(T)                                                                 \
+  template struct tref::imp::RtClassStorage<ZTrefRemoveParen(T)>;                               \
+  template tref::imp::RtClassStorage<ZTrefRemoveParen(T)>& tref::imp::rt_storage<ZTrefRemoveParen(T)>(); \
+  template const tref::imp::RtClass* tref::imp::register_class<ZTrefRemoveParen(T)>()
+
+}  // namespace imp
+
+//////////////////////////////////////////////////////////////////////////
+///
+/// public APIs
+///
+//////////////////////////////////////////////////////////////////////////
+
+using imp::each_class;
+using imp::find_class;
+using imp::register_class;
+using imp::RtClass;
+using imp::RtField;
+using imp::RtFieldKind;
+
+#define TrefExternClass ZTrefExternClass
+#define TrefInstantiateClass ZTrefInstantiateClass
+
+}  // namespace tref
+
+#endif
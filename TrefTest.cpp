@@ -1,9 +1,15 @@
+#include <array>
 #include <cassert>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <sstream>
+#include <thread>
 
 #include "Tref.hpp"
+#include "TrefData.hpp"
+#include "TrefRpc.hpp"
+#include "TrefRuntime.hpp"
 
 using namespace std;
 using namespace tref;
@@ -445,21 +451,157 @@ static_assert([] {
   return enum_info<TestEnumStaticDispatching>().items[idx].meta(c) == 111;
 }());
 
+// same as above through a jump table.
+static_assert(enum_dispatch(TestEnumStaticDispatching::EnumA) == 111);
+static_assert(enum_dispatch(TestEnumStaticDispatching::EnumB) == 222);
+
+enum class Opcode;
+constexpr int opAdd(int a, int b) {
+  return a + b;
+}
+constexpr int opSub(int a, int b) {
+  return a - b;
+}
+
+TrefEnumEx(Opcode, int, (Add = 10, &opAdd), (Sub = 20, &opSub));
+
+static_assert(enum_dispatch(Opcode::Add, 5, 3) == 8);
+static_assert(enum_dispatch(Opcode::Sub, 5, 3) == 2);
+
+//////////////////////////////////
+// enum flags
+
+TrefEnum(Perm, unsigned, None = 0, Read = 1, Write = 2, Exec = 4, ReadWrite = 3);
+TrefEnumFlags(Perm);
+
+static_assert(is_enum_flags_v<Perm>);
+static_assert(!is_enum_flags_v<SimpleEnum>);
+static_assert((Perm::Read | Perm::Exec) == (Perm)5);
+static_assert((~Perm::Read & Perm::ReadWrite) == Perm::Write);
+static_assert(string_to_flags("Read|Exec", Perm::None) == (Perm::Read | Perm::Exec));
+static_assert(string_to_flags(" Exec | ReadWrite ", Perm::None) == (Perm)7);
+static_assert(string_to_flags("Write|0x40", Perm::None) == (Perm)0x42);
+static_assert(string_to_flags("Read|Foo", Perm::Exec) == Perm::Exec);
+static_assert(string_to_flags("Read||Write", Perm::Exec) == Perm::Exec);
+static_assert(string_to_flags("0x100000000", Perm::Exec) == Perm::Exec);
+static_assert(string_to_flags("0xffffffff", Perm::None) == (Perm)0xffffffff);
+static_assert(string_to_flags("99999999999999999999", Perm::Exec) == Perm::Exec);
+static_assert([] {
+  int cnt = 0;
+  each_flag(Perm::Read | Perm::Exec, [&](auto& item) {
+    cnt += (int)item.value;
+    return true;
+  });
+  return cnt == 5;
+}());
+
+struct TestMemberFlags {
+  TrefMemberEnum(Mask, uint8_t, A = 1, B = 2);
+  TrefMemberEnumFlags(Mask);
+};
+static_assert((TestMemberFlags::Mask::A | TestMemberFlags::Mask::B) == (TestMemberFlags::Mask)3);
+
+void TestEnumFlags() {
+  assert(flags_to_string(Perm::Read | Perm::Exec) == "Read|Exec");
+  assert(flags_to_string(Perm::ReadWrite) == "ReadWrite");
+  assert(flags_to_string(Perm::None) == "None");
+  assert(flags_to_string(Perm::Write | (Perm)0x50) == "Write|0x50");
+
+  auto p = Perm::Read;
+  p |= Perm::Write;
+  assert(p == Perm::ReadWrite);
+  assert(string_to_flags(flags_to_string(p | Perm::Exec), Perm::None) == (Perm)7);
+
+  // no truncation: fails when too small.
+  char buf[9];
+  assert(flags_to_string(Perm::Read | Perm::Exec, buf, sizeof(buf)) == "Read|Exec");
+  assert(!flags_to_string(Perm::Read | Perm::Exec, buf, 8).data());
+  assert(flags_to_string(Perm::Write | (Perm)0xfffffff0) == "Write|0xfffffff0");
+}
+
+//////////////////////////////////
+// enum indexed containers
+
+TrefEnum(SparseEnum, int, Low = -5, Mid = 3, High = 100000);
+
+static_assert(enum_count_v<EnumA> == 2);
+static_assert(enum_index(EnumA::Ass) == 0);
+static_assert(enum_index(EnumA::Ban) == 1);
+static_assert(enum_index((EnumA)2) == -1);
+static_assert(enum_index(SparseEnum::Low) == 0);
+static_assert(enum_index(SparseEnum::High) == 2);
+static_assert(enum_index((SparseEnum)4) == -1);
+
+TrefEnum(WideEnum, uint64_t, Small = 1, Big = 0x8000000000000001ull, Max = 0xffffffffffffffffull);
+
+static_assert(imp::enum_max_v<WideEnum> == 0xffffffffffffffffull && imp::enum_min_v<WideEnum> == 1);
+static_assert(!imp::enum_use_lut_v<WideEnum>);
+static_assert(enum_index(WideEnum::Small) == 0 && enum_index(WideEnum::Big) == 1);
+static_assert(enum_index(WideEnum::Max) == 2 && enum_index((WideEnum)2) == -1);
+
+static_assert([] {
+  enum_map<EnumA, int> counters;
+  counters[EnumA::Ass] += 1;
+  counters[EnumA::Ban] += 2;
+  counters[EnumA::Ban] += 3;
+  return counters.size() == 2 && counters[EnumA::Ass] == 1 &&
+         counters[EnumA::Ban] == 5 && counters.find((EnumA)2) == nullptr;
+}());
+
+static_assert([] {
+  enum_set<SparseEnum> flags;
+  flags.insert(SparseEnum::High);
+  flags.insert(SparseEnum::Low);
+  flags.erase(SparseEnum::Low);
+  return flags.size() == 1 && flags.contains(SparseEnum::High) &&
+         !flags.contains(SparseEnum::Low) && !flags.insert((SparseEnum)4);
+}());
+
+void TestEnumContainers() {
+  enum_map<EnumValueMetaTest, int> m;
+  m[EnumValueMetaTest::TestB] = 3;
+  m.each([](auto& item, int& v) {
+    auto desc = item.meta.desc;
+    cout << item.name_view() << " (" << desc << "): " << v << endl;
+    return true;
+  });
+
+  enum_set<SparseEnum> s;
+  s.insert(SparseEnum::Mid);
+  s.insert(SparseEnum::High);
+  string names;
+  s.each([&](auto& item) {
+    names += item.name_view();
+    return true;
+  });
+  assert(names == "MidHigh");
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 template <typename T>
 void DumpEnum() {
   printf("========= Enum Members of %s ======\n", enum_info<T>().name.data());
   enum_info<T>().each_item([](auto info) {
-    printf("name: %s, val: %d\n", info.name, (int)info.value);
+    printf("name: %s, val: %d\n", info.name_view().data(), (int)info.value);
     return true;
   });
   puts("==================");
 }
 
+// names are trimmed C strings, stored once in the C++20 path
+#if ZTrefCxx20
+static_assert(sizeof(enum_info_v<Perm>.items[0]) < 32);
+#endif
+
 void TestEnum() {
   DumpEnum<EnumA>();
   DumpEnum<ExternalEnum>();
+
+  assert(enum_info_v<Perm>.items[2].name_view() == "Write");
+  assert(enum_to_string(Perm::Exec) == "Exec" && enum_to_string((Perm)8).empty());
+  assert(string_to_enum("ReadWrite", Perm::None) == Perm::ReadWrite);
+  assert(string_to_enum("Nope", Perm::Exec) == Perm::Exec);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -547,16 +689,15 @@ void dumpDetails() {
   });
 }
 
+// the range is used by the bit packing of TrefData.hpp.
 template <typename T>
-struct MetaNumber : Meta {
-  T minV, maxV;
-
+struct MetaNumber : Meta, MetaRange<T> {
   constexpr MetaNumber(const char* desc_, T minV_, T maxV_)
-      : Meta{desc_}, minV(minV_), maxV(maxV_) {}
+      : Meta{desc_}, MetaRange<T>{minV_, maxV_} {}
 
   std::string to_string() {
     std::ostringstream o;
-    o << "desc:" << desc << ",range:[" << minV << "," << maxV << "]";
+    o << "desc:" << desc << ",range:[" << this->minV << "," << this->maxV << "]";
     return o.str();
   }
 };
@@ -695,6 +836,103 @@ void TestHookable() {
   printf("====================\n");
 }
 
+//////////////////////////////
+// hook chains without allocation
+
+struct HookedUnit {
+  TrefType(HookedUnit);
+
+  int hp = 100;
+
+  int damage(int v) { return hp -= v; }
+  TrefHookable(damage);
+
+  int armor() const { return 2; }
+  TrefHookable(armor);
+
+  void heal(int v) { hp += v; }
+  TrefHookable(heal);
+
+  string rename(string name) { return name + "!"; }
+  TrefHookable(rename);
+
+  int level() const noexcept { return 3; }
+  TrefHookable(level);
+};
+
+static_assert(class_info<HookedUnit>().each_field_with_meta<MetaHookableBase>([](auto info, int) {
+  return info.meta.method == info.value;
+}));
+
+struct HookLog {
+  int pre = 0, post = 0;
+};
+
+void TestHookChain() {
+  HookedUnit u;
+  assert(call_hooked<&HookedUnit::damage>(u, 10) == 90);
+  assert(hook_chain_v<&HookedUnit::damage>.empty());
+
+  // install hooks for all hookable methods through reflection
+  HookLog log;
+  class_info<HookedUnit>().each_field_with_meta<MetaHookableBase>([&](auto info, int) {
+    if constexpr (is_same_v<decltype(info.value), decltype(&HookedUnit::damage)>) {
+      // halve the damage & log
+      auto pre = [](void* ctx, HookedUnit&, int& v) {
+        ((HookLog*)ctx)->pre++;
+        v /= 2;
+      };
+      auto post = [](void* ctx, HookedUnit&, int& ret, int&) {
+        ((HookLog*)ctx)->post++;
+        ret = -ret;
+      };
+      assert(info.meta.chain().add(pre, post, &log));
+    }
+    return true;
+  });
+
+  assert(call_hooked<&HookedUnit::damage>(u, 10) == -85 && u.hp == 85);
+  assert(log.pre == 1 && log.post == 1);
+
+  // calls by the reflected invocation path are hooked too
+  string     args, ret;
+  ByteWriter w(args), rw(ret);
+  encode_args<&HookedUnit::damage>(w, 20);
+  ByteReader in(args);
+  assert(invoke_method(u, "damage", in, rw) && u.hp == 75 && log.pre == 2);
+
+  auto& armor = hook_chain_v<&HookedUnit::armor>;
+  for (int i = 0; i < TrefMaxHooks; i++)
+    assert(armor.add(nullptr, [](void*, const HookedUnit&, int& r) { r++; }));
+  assert(!armor.add(nullptr));
+  assert(call_hooked<&HookedUnit::armor>(u) == 2 + TrefMaxHooks);
+  armor.clear();
+  assert(call_hooked<&HookedUnit::armor>(u) == 2);
+
+  auto healPre = [](void*, HookedUnit&, int& v) { v *= 2; };
+  hook_chain_v<&HookedUnit::heal>.add(healPre);
+  call_hooked<&HookedUnit::heal>(u, 5);
+  assert(u.hp == 85);
+  assert(hook_chain_v<&HookedUnit::heal>.remove(healPre));
+  assert(!hook_chain_v<&HookedUnit::heal>.remove(healPre));
+  call_hooked<&HookedUnit::heal>(u, 5);
+  assert(u.hp == 90);
+
+  // post hooks see by-value arguments intact.
+  auto& rename = hook_chain_v<&HookedUnit::rename>;
+  rename.add(nullptr, [](void*, HookedUnit&, string& ret, string& name) { ret += "|" + name; });
+  string longName(64, 'a');
+  assert(call_hooked<&HookedUnit::rename>(u, longName) == longName + "!|" + longName);
+  rename.clear();
+
+  auto& level = hook_chain_v<&HookedUnit::level>;
+  level.add(nullptr, [](void*, const HookedUnit&, int& r) { r *= 2; });
+  assert(call_hooked<&HookedUnit::level>(u) == 6);
+  level.clear();
+
+  hook_chain_v<&HookedUnit::damage>.clear();
+}
+
 template <typename T>
 struct TempSubChild : SubChild {
   TrefType(TempSubChild);
@@ -755,10 +993,1415 @@ static_assert(hasSubclass<Base>("SubChildOfTempSubChild3"));
 static_assert(hasSubclass<SubChild>("ExternalData"));
 static_assert(hasSubclass<Base>("ExternalData"));
 
+//////////////////////////////////////////////////////////////////////////
+// visit subclasses by stored subclass id
+
+struct Shape {
+  TrefType(Shape);
+  TrefSubclassId(Shape);
+
+  int id = 0;
+};
+
+struct Circle : Shape {
+  TrefType(Circle);
+  TrefSubclassId(Shape);
+
+  float radius = 1;
+};
+TrefSubType(Circle);
+
+struct Rect : Shape {
+  TrefType(Rect);
+  TrefSubclassId(Shape);
+
+  float w = 2, h = 3;
+};
+TrefSubType(Rect);
+
+struct Square : Rect {
+  TrefType(Square);
+  TrefSubclassId(Shape);
+};
+TrefSubType(Square);
+
+// the id is stamped again by the copy constructor.
+static_assert(!is_trivially_copyable_v<Shape> && !is_trivially_copyable_v<Square>);
+
+// no subclass id, visited as Rect.
+struct RoundRect : Rect {
+  TrefType(RoundRect);
+};
+TrefSubType(RoundRect);
+
+string_view visitedName(const Shape& s) {
+  return tref::visit(&s, [](auto& v) {
+    return class_info<std::decay_t<decltype(v)>>().name;
+  });
+}
+
+void TestVisit() {
+  Shape     shape;
+  Circle    circle;
+  Rect      rect;
+  Square    square;
+  RoundRect roundRect;
+
+  assert(get_subclass_id(&shape) == -1);
+  assert(get_subclass_id<Shape>(&circle) == (subclass_id<Shape, Circle>));
+  assert(get_subclass_id<Shape>(&square) == (subclass_id<Shape, Square>));
+
+  assert(visitedName(shape) == "Shape");
+  assert(visitedName(circle) == "Circle");
+  assert(visitedName(rect) == "Rect");
+  assert(visitedName(square) == "Square");
+  assert(visitedName(roundRect) == "Rect");
+
+  Shape* p = &rect;
+  auto   area = tref::visit(p, [](auto& v) -> float {
+    using S = std::decay_t<decltype(v)>;
+    if constexpr (is_base_of_v<Rect, S>)
+      return v.w * v.h;
+    else
+      return 0;
+  });
+  assert(area == 6);
+
+  auto copied = square;
+  assert(visitedName(copied) == "Square");
+
+  // slicing & assignment keep the id of the object itself.
+  Shape sliced = circle;
+  assert(visitedName(sliced) == "Shape");
+  Rect slicedRect = square;
+  assert(visitedName(slicedRect) == "Rect");
+  Shape& r = rect;
+  r = circle;
+  assert(visitedName(rect) == "Rect");
+  sliced = square;
+  assert(visitedName(sliced) == "Shape");
+  Square moved = std::move(copied);
+  assert(visitedName(moved) == "Square");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// clone
+
+struct Prefab {
+  TrefType(Prefab);
+  TrefSubclassId(Prefab);
+
+  virtual ~Prefab() = default;
+  virtual int kind() const { return 0; }
+
+  string name = "prefab";
+};
+
+struct LightPrefab : Prefab {
+  TrefType(LightPrefab);
+  TrefSubclassId(Prefab);
+
+  int kind() const override { return 1; }
+
+  float          intensity = 1;
+  vector<string> tags;
+};
+TrefSubType(LightPrefab);
+
+struct SpotPrefab : LightPrefab {
+  TrefType(SpotPrefab);
+  TrefSubclassId(Prefab);
+
+  int kind() const override { return 2; }
+
+  float angle = 30;
+};
+TrefSubType(SpotPrefab);
+
+template <typename = void>
+void TestClone() {
+  static_assert(!is_trivially_copyable_v<LightPrefab>);
+  // RoundRect would be cloned as a Rect.
+  static_assert(is_clonable_v<Prefab> && !is_clonable_v<Shape>);
+
+  SpotPrefab spot;
+  spot.name = "spot";
+  spot.angle = 45;
+  Prefab* s = tref::clone<Prefab>(&spot);
+  assert(s->kind() == 2 && s->name == "spot" && static_cast<SpotPrefab*>(s)->angle == 45);
+  delete s;
+
+  assert(tref::clone<Prefab>(nullptr) == nullptr);
+
+  alignas(16) char buf[256];
+  size_t           used = 0;
+  auto             arena = [&](size_t size, size_t align) -> void* {
+    used = (used + align - 1) / align * align;
+    if (used + size > sizeof(buf))
+      return nullptr;
+    auto p = buf + used;
+    used += size;
+    return p;
+  };
+
+  LightPrefab light;
+  light.name = "lamp";
+  light.intensity = 2;
+  light.tags = {"a", "b"};
+  Prefab* p = tref::clone<Prefab>(&light, arena);
+  assert(p->kind() == 1 && p->name == "lamp");
+  auto l = static_cast<LightPrefab*>(p);
+  assert(l->intensity == 2 && l->tags.size() == 2);
+  assert(light.tags.size() == 2);
+
+  Prefab* m = tref::clone_move(p, arena);
+  assert(m->kind() == 1 && static_cast<LightPrefab*>(m)->tags.size() == 2);
+  assert(l->tags.empty());
+  p->~Prefab();
+  m->~Prefab();
+
+  // out of memory.
+  used = sizeof(buf);
+  assert(tref::clone<Prefab>(&light, arena) == nullptr);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// csv loading
+
+struct CsvBase {
+  TrefType(CsvBase);
+
+  int id = 0;
+  TrefField(id);
+};
+
+struct CsvRow : CsvBase {
+  TrefType(CsvRow);
+
+  string   name;
+  float    price = 0;
+  uint16_t count = 0;
+  Perm     perm = Perm::None;
+  bool     enabled = false;
+  TrefField(name);
+  TrefField(price);
+  TrefField(count);
+  TrefField(perm);
+  TrefField(enabled);
+};
+TrefSubType(CsvRow);
+
+void TestCsv() {
+  auto csv =
+      "id,name,price,unknown,perm,count,enabled\n"
+      "1,apple,1.5,x,Read|Write,10,true\n"
+      "\n"
+      "2,\"pear, \"\"green\"\"\",2.25,y,Exec,20,0\r\n"
+      "3,,0,z,4,30\n"sv;
+
+  vector<CsvRow> rows;
+  auto           r = load_csv(csv, rows);
+  assert(r.ok && r.rows == 3 && rows.size() == 3);
+  assert(rows[0].id == 1 && rows[0].name == "apple" && rows[0].price == 1.5f);
+  assert(rows[0].perm == Perm::ReadWrite && rows[0].count == 10 && rows[0].enabled);
+  assert(rows[1].name == "pear, \"green\"" && rows[1].price == 2.25f);
+  assert(rows[1].perm == Perm::Exec && !rows[1].enabled);
+  assert(rows[2].name.empty() && rows[2].perm == Perm::Exec && rows[2].count == 30);
+
+  // tsv, in parallel chunks.
+  string tsv = "count\tname\n";
+  for (int i = 0; i < 1000; i++)
+    tsv += to_string(i) + "\tn" + to_string(i) + "\n";
+  rows.clear();
+  r = load_csv(tsv, rows, {'\t', 4, 64});
+  assert(r.ok && rows.size() == 1000);
+  for (int i = 0; i < 1000; i++)
+    assert(rows[i].count == i && rows[i].name == "n" + to_string(i) && rows[i].id == 0);
+
+  columns_t<CsvRow> cols;
+  r = load_csv_columns<CsvRow>(tsv, cols, {'\t', 4, 64});
+  constexpr auto countIdx = class_info_v<CsvRow>.get_field_index("count");
+  constexpr auto idIdx = class_info_v<CsvRow>.get_field_index("id");
+  assert(r.ok && get<countIdx>(cols).size() == 1000 && get<countIdx>(cols)[999] == 999);
+  assert(get<idIdx>(cols).size() == 1000);
+
+  rows.clear();
+  r = load_csv("id,count\n1,2\n3,70000\n4,5\n"sv, rows);
+  assert(!r.ok && rows.empty() && r.error_row == 1 && r.error_column == "count");
+
+  // quoted new lines never split the parallel chunks.
+  string multiline = "id,name\n";
+  for (int i = 0; i < 200; i++)
+    multiline += to_string(i) + ",\"a\n\"\"b\"\"\nc\"\n";
+  rows.clear();
+  r = load_csv(multiline, rows, {',', 4, 64});
+  assert(r.ok && rows.size() == 200 && rows[199].id == 199);
+  for (auto& row : rows)
+    assert(row.name == "a\n\"b\"\nc");
+
+  rows.clear();
+  r = load_csv("count\n+5\n+-5\n"sv, rows);
+  assert(!r.ok && r.error_row == 1);
+  r = load_csv_file("/nonexistent/rows.csv", rows);
+  assert(!r.ok && rows.empty());
+
+  // a field named twice, unknown columns may repeat.
+  auto dup = "id,count,unknown,unknown,id\n1,2,3,4,5\n"sv;
+  r = load_csv(dup, rows);
+  assert(!r.ok && rows.empty() && r.error_column == "id");
+  columns_t<CsvRow> dupCols;
+  r = load_csv_columns<CsvRow>(dup, dupCols);
+  assert(!r.ok && get<idIdx>(dupCols).empty() && r.error_column == "id");
+  r = load_csv("id,unknown,unknown\n1,2,3\n"sv, rows);
+  assert(r.ok && rows.size() == 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// binary codec & method invocation
+
+struct RpcPoint {
+  TrefType(RpcPoint);
+
+  int   x = 0;
+  float y = 0;
+  TrefField(x);
+  TrefField(y);
+};
+
+struct RpcService {
+  TrefType(RpcService);
+
+  int base = 0;
+  TrefField(base);
+
+  int add(int a, int b) { return base + a + b; }
+  TrefField(add);
+
+  string greet(const string& who, string_view suffix) const { return "hi " + who + string(suffix); }
+  TrefField(greet);
+
+  void push(vector<RpcPoint> pts) { base += (int)pts.size(); }
+  TrefField(push);
+
+  static Perm twice(Perm p) { return p | p; }
+  TrefField(twice);
+
+  int* raw(int* p) { return p; }
+  TrefField(raw);
+};
+
+static_assert(is_codable_v<tuple<int, string, vector<RpcPoint>, array<Perm, 2>>>);
+static_assert(!is_codable_v<int*>);
+static_assert(is_codable_v<vector<bool>>);
+
+// encoded as nothing.
+struct RpcEmpty {
+  TrefType(RpcEmpty);
+};
+
+void TestRpcThunks() {
+  // function addresses are not constant expressions under -fsanitize=function.
+  constexpr auto& thunks = method_thunks_v<RpcService>;
+  assert(thunks[class_info_v<RpcService>.get_field_index("add")]);
+  assert(thunks[class_info_v<RpcService>.get_field_index("twice")]);
+  assert(!thunks[class_info_v<RpcService>.get_field_index("base")]);
+  assert(!thunks[class_info_v<RpcService>.get_field_index("raw")]);
+
+  string     buf;
+  ByteWriter w(buf);
+  encode(w, tuple{1, "abc"s, vector<RpcPoint>{{2, 3.5f}}, Perm::ReadWrite});
+
+  ByteReader                                      r(buf);
+  tuple<int, string_view, vector<RpcPoint>, Perm> v;
+  assert(decode(r, v) && r.remaining() == 0);
+  assert(get<0>(v) == 1 && get<1>(v) == "abc" && get<2>(v)[0].y == 3.5f && get<3>(v) == Perm::ReadWrite);
+
+  ByteReader truncated(string_view(buf).substr(0, buf.size() - 1));
+  assert(!decode(truncated, v));
+
+  buf.clear();
+  encode(w, vector<bool>{true, false, true});
+  ByteReader   bits(buf);
+  vector<bool> flags;
+  assert(decode(bits, flags) && flags == vector<bool>({true, false, true}) && !bits.remaining());
+
+  // counts are bounded by the size of the elements, or a cap if they have none.
+  buf.clear();
+  encode(w, vector<RpcEmpty>(5));
+  ByteReader       empties(buf);
+  vector<RpcEmpty> es;
+  assert(decode(empties, es) && es.size() == 5 && !empties.remaining());
+  buf.clear();
+  encode(w, vector<RpcEmpty>(TrefCodecMaxEmptyElems + 1));
+  assert(!decode(empties = ByteReader(buf), es));
+  buf.clear();
+  w.write_raw(uint32_t(2));
+  w.write_raw(uint32_t(1));
+  vector<RpcPoint> points;
+  assert(!decode(empties = ByteReader(buf), points));
+
+  RpcService svc;
+  svc.base = 100;
+  string     args, ret;
+  ByteWriter argsW(args), retW(ret);
+
+  encode_args<&RpcService::add>(argsW, 1, 2.0);
+  ByteReader in(args);
+  assert(invoke_method(svc, "add", in, retW));
+  ByteReader out(ret);
+  int        sum = 0;
+  assert(decode(out, sum) && sum == 103);
+
+  args.clear();
+  ret.clear();
+  encode_args<&RpcService::greet>(argsW, "bob", "!");
+  in = ByteReader(args);
+  assert(invoke_method(svc, "greet", in, retW));
+  out = ByteReader(ret);
+  string greeting;
+  assert(decode(out, greeting) && greeting == "hi bob!");
+
+  args.clear();
+  encode_args<&RpcService::push>(argsW, vector<RpcPoint>(3));
+  in = ByteReader(args);
+  assert(invoke_method(svc, "push", in, retW) && svc.base == 103);
+
+  in = ByteReader(string_view(args).substr(0, 2));
+  assert(!invoke_method(svc, "push", in, retW));
+  args += '\0';
+  in = ByteReader(args);
+  assert(!invoke_method(svc, "push", in, retW) && svc.base == 103);
+  assert(!invoke_method(svc, "base", in, retW));
+  assert(!invoke_method(svc, "notExist", in, retW));
+}
+
+struct MetaRpcExport {};
+
+struct RpcTaggedService : RpcService {
+  TrefType(RpcTaggedService);
+
+  int mul(int a, int b) { return a * b; }
+  TrefFieldWithMeta(mul, MetaRpcExport{});
+
+  int internal() { return 0; }
+  TrefField(internal);
+
+  void reset() { base = 0; }
+  TrefFieldWithMeta(reset, MetaRpcExport{});
+};
+
+using RpcAll = RpcRouter<RpcService>;
+using RpcTagged = RpcRouter<RpcTaggedService, MetaRpcExport>;
+
+static_assert(RpcAll::size == 4);
+static_assert(RpcAll::method_id("add") == 0 && RpcAll::method_id("twice") == 3);
+static_assert(RpcAll::method_id("raw") == -1 && RpcAll::method_id("base") == -1);
+static_assert(RpcAll::method_name(1) == "greet");
+static_assert(RpcAll::method_name(-1).empty() && RpcAll::method_name(4).empty());
+static_assert(RpcAll::method_id_of<&RpcService::push>() == 2);
+static_assert(RpcTagged::size == 2);
+static_assert(RpcTagged::method_id("mul") == 0 && RpcTagged::method_id("reset") == 1);
+static_assert(RpcTagged::method_id("add") == -1 && RpcTagged::method_id("internal") == -1);
+
+void TestRpcRouter() {
+  RpcTaggedService svc;
+  svc.base = 5;
+
+  string     calls, results;
+  ByteWriter w(calls), rw(results);
+  RpcTagged::encode_call<&RpcTaggedService::mul>(w, 6, 7);
+  RpcTagged::encode_call<&RpcTaggedService::reset>(w);
+  RpcTagged::encode_call<&RpcTaggedService::mul>(w, 2, 3);
+  w.write_raw((uint16_t)9);
+  w.write_raw((uint32_t)0);
+  assert(RpcTagged::dispatch(svc, calls, rw) == 4 && svc.base == 0);
+
+  ByteReader r(results);
+  int        v = 0;
+  assert(RpcTagged::decode_result(r, v) && v == 42);
+  assert(RpcTagged::decode_result(r));
+  assert(RpcTagged::decode_result(r, v) && v == 6);
+  assert(!RpcTagged::decode_result(r) && r.remaining() == 0);
+
+  // trailing argument bytes, the method is not called.
+  svc.base = 5;
+  calls.clear();
+  results.clear();
+  w.write_raw((uint16_t)RpcTagged::method_id("reset"));
+  w.write_raw((uint32_t)1);
+  w.write_raw((uint8_t)0);
+  assert(RpcTagged::dispatch(svc, calls, rw) == 1 && svc.base == 5);
+  r = ByteReader(results);
+  assert(!RpcTagged::decode_result(r) && r.remaining() == 0);
+
+  // truncated batch
+  calls.resize(3);
+  assert(RpcTagged::dispatch(svc, calls, rw) == -1);
+}
+
+//////////////////////////////
+// profiling of reflected methods
+
+struct ProfiledService {
+  TrefType(ProfiledService);
+
+  int calls = 0;
+
+  int work(int n) {
+    calls++;
+    volatile int r = 0;
+    for (int i = 0; i < n; i++)
+      r = r + i;
+    return r;
+  }
+  TrefFieldWithMeta(work, MetaProfiled{});
+
+  int hooked(int v) { return v; }
+  TrefFieldWithMeta(hooked, (Metas{MetaHookable<&this_t::hooked>{}, MetaProfiled{}}));
+
+  int plain() { return calls; }
+  TrefField(plain);
+};
+
+// the meta adds no bytes
+static_assert(sizeof(get<1>(class_fields_v<ProfiledService>)) <=
+              sizeof(FieldInfo<decltype(&ProfiledService::work), nullptr_t>));
+
+void TestProfiling() {
+  ProfiledService svc;
+  string          args, ret;
+  ByteWriter      w(args), rw(ret);
+  encode_args<&ProfiledService::work>(w, 1000);
+
+  auto callWork = [&](int times) {
+    for (int i = 0; i < times; i++) {
+      ByteReader in(args);
+      assert(invoke_method(svc, "work", in, rw));
+    }
+  };
+
+  callWork(10);
+  thread t([&] { callWork(5); });
+  t.join();
+
+  args.clear();
+  encode_args<&ProfiledService::hooked>(w, 1);
+  ByteReader in(args);
+  assert(invoke_method(svc, "hooked", in, rw));
+  assert(svc.calls == 15);
+
+#if TrefProfiling
+  vector<ProfileStats> stats;
+  profile_snapshot(stats);
+  auto find = [&](string_view name) {
+    for (auto& s : stats)
+      if (s.class_name == "ProfiledService" && s.method_name == name)
+        return &s;
+    return (ProfileStats*)nullptr;
+  };
+  assert(!find("plain"));
+  auto work = find("work");
+  assert(work && work->count == 15 && work->total_ns > 0);
+  assert(work->percentile(50) <= work->percentile(100));
+
+  ProfileStats one;
+  one.count = one.hist[10] = 1;
+  assert(one.percentile(50) == 1024 && one.percentile(0) == 1024 && one.percentile(100) == 1024);
+  ProfileStats outlier;
+  outlier.count = 10;
+  outlier.hist[3] = 9;
+  outlier.hist[21] = 1;
+  assert(outlier.percentile(50) == 8 && outlier.percentile(90) == 8);
+  assert(outlier.percentile(99) == uint64_t(1) << 21 && outlier.percentile(100) == uint64_t(1) << 21);
+  assert(ProfileStats{}.percentile(99) == 0);
+  uint64_t histSum = 0;
+  for (auto h : work->hist)
+    histSum += h;
+  assert(histSum == 15);
+  assert(find("hooked") && find("hooked")->count == 1);
+
+  ProfileAggregator agg;
+  agg.tick(stats);
+  callWork(3);
+  agg.tick(stats);
+  assert(find("work") && find("work")->count == 3);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+// compiled property paths
+
+struct PathVec {
+  TrefType(PathVec);
+
+  float x = 0, y = 0, z = 0;
+  TrefField(x);
+  TrefField(y);
+  TrefField(z);
+};
+
+struct PathTransform {
+  TrefType(PathTransform);
+
+  PathVec pos;
+  PathVec scale[2];
+  TrefField(pos);
+  TrefField(scale);
+};
+
+struct PathItem {
+  TrefType(PathItem);
+
+  int    count = 0;
+  string name;
+  TrefField(count);
+  TrefField(name);
+};
+
+struct PathEntity : Base {
+  TrefType(PathEntity);
+
+  PathTransform         transform;
+  vector<PathItem>      items;
+  array<vector<int>, 2> grid;
+  TrefField(transform);
+  TrefField(items);
+  TrefField(grid);
+
+  int method() { return 0; }
+  TrefField(method);
+};
+
+struct PathNode {
+  TrefType(PathNode);
+
+  int              v = 0;
+  vector<PathNode> children;
+  TrefField(v);
+  TrefField(children);
+};
+
+struct PathPlain {
+  TrefType(PathPlain);
+
+  int x = 0;
+  TrefField(x);
+};
+
+// x follows the vptr in PathPoly but is first in PathPlain.
+struct PathPoly : PathPlain {
+  TrefType(PathPoly);
+
+  virtual ~PathPoly() = default;
+  int y = 0;
+  TrefField(y);
+};
+
+void TestCompiledPath() {
+  PathEntity e;
+  e.baseVal = 7;
+  e.items.resize(4);
+  e.grid[1] = {10, 20, 30};
+
+  auto x = compile_path<PathEntity>("transform.pos.x");
+  assert(x.valid() && x.value_type == type_id<float>());
+  assert(x.set(e, 3.5f) && e.transform.pos.x == 3.5f);
+  assert(*x.get<float>(e) == 3.5f && !x.get<int>(e));
+
+  auto y = compile_path<PathEntity>("transform.scale[1].y");
+  assert(y.resolve(e) == &e.transform.scale[1].y);
+
+  auto count = compile_path<PathEntity>("items[3].count");
+  assert(count.set(e, 9) && e.items[3].count == 9);
+  e.items.resize(2);
+  assert(!count.get<int>(e));
+
+  auto ch = compile_path<PathEntity>("items[1].name[2]");
+  e.items[1].name = "abcd";
+  assert(*ch.get<char>(e) == 'c');
+
+  assert(*compile_path<PathEntity>("grid[1][2]").get<int>(e) == 30);
+  assert(*compile_path<PathEntity>("baseVal").get<int>(e) == 7);
+  assert(compile_path<PathEntity>("").get<PathEntity>(e) == &e);
+  assert(compile_path<PathEntity>("transform.pos").get<PathVec>(e) == &e.transform.pos);
+
+  PathPoly poly;
+  assert(compile_path<PathPoly>("x").get<int>(poly) == &poly.x);
+  assert(compile_path<PathPoly>("x").set(poly, 3) && poly.x == 3);
+  assert(compile_path<PathPoly>("y").get<int>(poly) == &poly.y);
+
+  for (auto bad : {"nope", "transform.pos.w", "transform.scale[2]", "items[", "items[x]",
+                   "items.count", "method", "transform..pos", "baseVal.x", "grid[0]]",
+                   "items[18446744073709551616].count", "grid[99999999999999999999999]"}) {
+    assert(!compile_path<PathEntity>(bad).valid());
+  }
+
+  // every dynamic index takes a step, the last offset takes another one.
+  PathNode root;
+  string   deepest = "v";
+  for (int i = 0; i < TrefMaxPathSteps - 1; i++)
+    deepest = "children[0]." + deepest;
+  auto node = &root;
+  for (int i = 0; i < TrefMaxPathSteps - 1; i++)
+    node = &node->children.emplace_back();
+  node->v = 5;
+  assert(*compile_path<PathNode>(deepest).get<int>(root) == 5);
+  assert(!compile_path<PathNode>("children[0]." + deepest).valid());
+  assert(!compile_path<PathNode>("children[0].children[0]." + deepest).valid());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// runtime registry
+
+struct RtRaceMember {
+  TrefType(RtRaceMember);
+
+  int v = 0;
+  TrefField(v);
+};
+
+struct RtRaceHolder {
+  TrefType(RtRaceHolder);
+
+  RtRaceMember member;
+  TrefField(member);
+};
+
+struct RtPubMember {
+  TrefType(RtPubMember);
+
+  int v = 0;
+  TrefField(v);
+};
+
+struct RtPubBase {
+  TrefType(RtPubBase);
+
+  int b = 0;
+  TrefField(b);
+};
+
+struct RtPubDerived : RtPubBase {
+  TrefType(RtPubDerived);
+
+  RtPubMember member;
+  TrefField(member);
+};
+TrefSubType(RtPubDerived);
+
+template <typename = void>
+void TestRuntimeRegistry() {
+  auto sub = register_class<SubChild>();
+  assert(sub && sub->name == "SubChild" && sub == find_class("SubChild"));
+  assert(find_class(type_id<SubChild>()) == sub && register_class<SubChild>() == sub);
+
+  // the whole hierarchy is registered
+  auto base = find_class("Base");
+  auto child2 = find_class(type_id<Child2>());
+  assert(base && !base->base && child2 && child2->base->name == "Data");
+  assert(child2->base == find_class(type_id<Data<float, void>>()));
+  assert(sub->is_a(base) && !base->is_a(sub));
+  assert(find_class(type_id<SubChildOfTempSubChild3>()));
+  assert(!find_class("NotExist") && !find_class(type_id<int>()));
+
+  auto hasSub = [](const RtClass* c, const RtClass* s) {
+    for (int i = 0; i < c->subclass_count; i++)
+      if (c->subclasses[i] == s)
+        return true;
+    return false;
+  };
+  assert(hasSub(child2, sub) && hasSub(base, find_class(type_id<Data<int, void>>())));
+
+  // fields
+  assert(sub->field_count == (int)tuple_size_v<decltype(class_fields_v<SubChild>)>);
+  SubChild obj;
+  obj.baseVal = 3;
+  auto baseVal = sub->find_field("baseVal");
+  assert(baseVal && baseVal->kind == RtFieldKind::Data && baseVal->size == sizeof(int));
+  assert(baseVal->get<int>(&obj) == &obj.baseVal && !baseVal->get<float>(&obj));
+  assert(sub->find_field("t")->get_meta<Meta>()->desc == "test"sv);
+  assert(sub->find_field("x")->get_meta<MetaNumber<int>>()->maxV == 100);
+  assert(sub->find_field("func")->kind == RtFieldKind::Method);
+  assert(!sub->find_field("func")->get<int>(&obj));
+  assert(sub->get_meta<MetaExportedClass>());
+
+  auto p = sub->create();
+  assert(*sub->find_field("ff")->get<const char*>(p) == "subchild"sv);
+  sub->destroy(p);
+
+  // classes of members
+  register_class<PathEntity>();
+  auto transform = find_class("PathEntity")->find_field("transform");
+  assert(transform->type_class() && transform->type_class()->name == "PathTransform");
+  assert(find_class("PathVec") && find_class("PathTransform")->find_field("pos")->offset ==
+                                      offsetof(PathTransform, pos));
+
+  // inherited fields are at their offset in the derived class.
+  PathPoly poly;
+  assert(register_class<PathPoly>()->find_field("x")->get<int>(&poly) == &poly.x);
+  assert(find_class("PathPlain")->find_field("x")->get<int>(static_cast<PathPlain*>(&poly)) == &poly.x);
+
+  // lock-free concurrent reads
+  vector<thread> readers;
+  atomic<int>    found{0};
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&] {
+      for (int k = 0; k < 1000; k++)
+        found += find_class("SubChild") == sub && find_class(type_id<Child>()) != nullptr;
+    });
+  }
+  for (auto& t : readers)
+    t.join();
+  assert(found == 4000);
+
+  int cnt = 0;
+  each_class([&](const RtClass*) { return ++cnt; });
+  assert(cnt > 10);
+
+  // concurrent registrations return after the member classes are visible.
+  vector<thread> registrars;
+  atomic<int>    ready{0}, complete{0};
+  for (int i = 0; i < 4; i++) {
+    registrars.emplace_back([&] {
+      for (ready++; ready < 4;)
+        this_thread::yield();
+      complete += register_class<RtRaceHolder>() && find_class("RtRaceMember");
+    });
+  }
+  for (auto& t : registrars)
+    t.join();
+  assert(complete == 4);
+
+  // a class found by a concurrent lookup is linked with its whole tree.
+  atomic<bool> linked{false};
+  thread       finder([&] {
+    const RtClass* c = nullptr;
+    while (!(c = find_class("RtPubDerived")))
+      this_thread::yield();
+    linked = c->base && c->base == find_class("RtPubBase") && c->base->subclass_count == 1 &&
+             c->find_field("member")->type_class() == find_class("RtPubMember");
+  });
+  assert(register_class<RtPubDerived>());
+  finder.join();
+  assert(linked);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// field layout
+
+struct LayoutBase {
+  TrefType(LayoutBase);
+
+  uint8_t tag;
+  TrefField(tag);
+};
+
+struct LayoutPacket : LayoutBase {
+  TrefType(LayoutPacket);
+
+  double  value;
+  EnumA   kind;
+  int*    ref;
+  float   samples[3];
+  PathVec pos;
+  bool    ok;
+  TrefField(value);
+  TrefField(kind);
+  TrefField(ref);
+  TrefField(samples);
+  TrefField(pos);
+  TrefField(ok);
+
+  static inline int count = 0;
+  TrefField(count);
+  void update() {}
+  TrefField(update);
+};
+
+constexpr auto& packetLayout = layout_v<LayoutPacket>;
+static_assert(has_constexpr_layout_v<LayoutPacket> && packetLayout.size() == 7);
+static_assert(packetLayout[0].name == "tag" && packetLayout[0].offset == 0);
+static_assert(packetLayout[1].offset == 8 && packetLayout[1].kind == LayoutKind::Float);
+static_assert(packetLayout[2].kind == LayoutKind::Enum && packetLayout[3].kind == LayoutKind::Pointer);
+static_assert(packetLayout[4].size == sizeof(float[3]) && packetLayout[4].kind == LayoutKind::Array);
+static_assert(packetLayout[5].align == alignof(float) && packetLayout[5].kind == LayoutKind::Class);
+static_assert(packetLayout[6].kind == LayoutKind::Bool && field_offset(&LayoutPacket::ok) == 56);
+
+static_assert(padding_bytes_v<LayoutPacket> == 18 && packed_size_v<LayoutPacket> == 48);
+static_assert(layout_stats_v<LayoutPacket>.split_fields == 0);
+static_assert(packed_layout_v<LayoutPacket>[0].name == "value" && packed_layout_v<LayoutPacket>[1].name == "ref");
+static_assert(packed_layout_v<LayoutPacket>[4].name == "pos" && packed_layout_v<LayoutPacket>[4].offset == 32);
+static_assert(packed_layout_v<LayoutPacket>[6].name == "ok" && packed_layout_v<LayoutPacket>[6].offset == 45);
+static_assert(assert_no_cacheline_split<LayoutPacket, &LayoutPacket::samples>);
+static_assert(assert_no_cacheline_split<LayoutPacket, &LayoutBase::tag>);
+
+struct LayoutSplit : LayoutBase {
+  TrefType(LayoutSplit);
+
+  char head[59];
+  int  pair[2];
+  TrefField(head);
+  TrefField(pair);
+};
+TrefSubType(LayoutSplit);
+
+static_assert(padding_bytes_v<LayoutSplit> == 0 && layout_stats_v<LayoutSplit>.split_fields == 1);
+
+void TestLayout() {
+  LayoutPacket p;
+  for (auto& f : packetLayout)
+    assert(f.offset % f.align == 0 && f.offset + f.size <= sizeof(p));
+  assert((char*)&p + packetLayout[5].offset == (char*)&p.pos);
+
+  // Not constant for types with a non-trivial destructor before C++20.
+  auto& l = layout_v<PathEntity>;
+  assert(l.size() == 4 && l[0].name == "baseVal" && l[3].name == "grid");
+  PathEntity e;
+  assert((char*)&e + l[2].offset == (char*)&e.items && l[2].size == sizeof(e.items));
+  assert((char*)&e + l[3].offset == (char*)&e.grid && l[3].kind == LayoutKind::Class);
+
+  auto report = layout_report<LayoutBase>();
+  assert(report.find("LayoutBase: size 1, padding 0, packed 1\n") == 0);
+  assert(report.find("LayoutSplit: size 68, padding 0, packed 68\n") != string::npos);
+  assert(report.find("  +60 pair: 8 bytes, splits cache line\n") != string::npos);
+  report = layout_report<LayoutPacket>();
+  assert(report.find("  packed order: value ref kind samples pos tag ok, 48 bytes\n") != string::npos);
+  assert(layout_stats_of<PathEntity>().used == sizeof(int) + sizeof(PathTransform) +
+                                                   sizeof(e.items) + sizeof(e.grid));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// bulk registration
+
+struct BulkBase {
+  TrefType(BulkBase);
+
+  int a = 1;
+  TrefField(a);
+
+  int   b = 2, c = 3;
+  float d = 4;
+  int   get() const { return a; }
+  TrefFields(b, c, d, get);
+};
+
+struct BulkA : BulkBase {
+  TrefType(BulkA);
+};
+
+struct BulkB : BulkBase {
+  TrefType(BulkB);
+
+  int e = 5;
+  TrefFields(e);
+};
+
+struct BulkC : BulkB {
+  TrefType(BulkC);
+};
+TrefSubTypes(BulkA, BulkB);
+TrefSubType(BulkC);
+
+// ZTrefField and ZTrefFields mixed in any order.
+struct BulkMixed {
+  TrefType(BulkMixed);
+
+  int a = 0, b = 0, c = 0, d = 0;
+  TrefField(a);
+  TrefFields(b, c);
+  TrefField(d);
+};
+
+static_assert(tuple_size_v<decltype(class_fields_v<BulkMixed>)> == 4);
+static_assert(get<2>(class_fields_v<BulkMixed>).name == "c" && get<2>(class_fields_v<BulkMixed>).index == 3);
+static_assert(get<3>(class_fields_v<BulkMixed>).name == "d" && get<3>(class_fields_v<BulkMixed>).index == 4);
+static_assert(get<2>(class_fields_v<Data<int, void>>).name == "x" && get<2>(class_fields_v<Data<int, void>>).index == 2);
+static_assert([] {
+  int n = 0;
+  return class_info<BulkMixed>().each_field([&](auto info, int) { return info.index == ++n; });
+}());
+
+static_assert(tuple_size_v<decltype(class_fields_v<BulkBase>)> == 5);
+static_assert(get<3>(class_fields_v<BulkBase>).name == "d" && get<3>(class_fields_v<BulkBase>).index == 4);
+static_assert(get<4>(class_fields_v<BulkBase>).value == &BulkBase::get);
+static_assert(class_info<BulkC>().get_field_index("e") == 5);
+static_assert(is_same_v<decltype(class_info<BulkBase>().get_subclasses()),
+                        tuple<tref::imp::Type<BulkA>, tref::imp::Type<BulkB>, tref::imp::Type<BulkC>>>);
+
+template <typename = void>
+void TestBulkRegistration() {
+  BulkC c;
+  int   sum = 0;
+  class_info<BulkC>().each_field([&](auto info, int) {
+    if constexpr (is_member_object_pointer_v<decltype(info.value)>)
+      sum += (int)(c.*info.value);
+    return true;
+  });
+  assert(sum == 15);
+
+  string names;
+  class_info<BulkBase>().each_subclass([&](auto info, int level) {
+    names += string(level, ' ') + string(info.name) + ";";
+    return true;
+  });
+  assert(names == "BulkA;BulkB; BulkC;");
+}
+
+//////////////////////////////
+// flattened field & subclass lists
+
+template <typename = void>
+void TestFlattenedLists() {
+  // depth-first with the levels relative to the class
+  string tree;
+  class_info<Child2>().each_subclass([&](auto info, int level) {
+    tree += to_string(level) + string(info.name) + ";";
+    return true;
+  });
+  assert(tree.rfind("0SubChild;1TempSubChild;2SubChildOfTempSubChild1;1TempSubChild;", 0) == 0);
+
+  // direct subclasses first, the order used by subclass ids
+  using Subs = decltype(class_info<Child2>().get_subclasses());
+  static_assert(is_same_v<tuple_element_t<0, Subs>::type, SubChild>);
+  static_assert(is_same_v<tuple_element_t<1, Subs>::type, TempSubChild<int>>);
+  static_assert(subclass_id<Child2, SubChildOfTempSubChild1> > subclass_id<Child2, ExternalData>);
+
+  static_assert(class_info<SubChild>().each_field([](auto info, int level) {
+    return info.name != "baseVal" || level == 3;
+  }));
+  static_assert(get<0>(class_fields_v<SubChild>).name == "baseVal");
+}
+
+//////////////////////////////
+// runtime descriptors built in one translation unit
+
+struct SharedRt {
+  TrefType(SharedRt);
+
+  int   id;
+  float weight;
+  TrefFields(id, weight);
+};
+
+struct SharedRtSub : SharedRt {
+  TrefType(SharedRtSub);
+};
+TrefSubType(SharedRtSub);
+
+// normally in the header of SharedRt
+TrefExternClass(SharedRt);
+TrefExternClass(SharedRtSub);
+
+template <typename = void>
+void TestExternClass() {
+  auto c = register_class<SharedRtSub>();
+  assert(c == find_class("SharedRtSub") && c->base == find_class(type_id<SharedRt>()));
+  assert(c->base->subclass_count == 1 && c->base->subclasses[0] == c);
+  assert(c->find_field("weight")->offset == offsetof(SharedRt, weight));
+}
+
+//////////////////////////////
+// convert
+
+struct ConvPos {
+  TrefType(ConvPos);
+
+  float x = 0, y = 0;
+  TrefField(x);
+  TrefField(y);
+};
+
+struct ConvPosDto {
+  TrefType(ConvPosDto);
+
+  double y = 0, x = 0;
+  TrefField(y);
+  TrefField(x);
+};
+
+struct ConvRowBase {
+  TrefType(ConvRowBase);
+
+  int64_t rowid = 0;
+  TrefField(rowid);
+};
+
+struct ConvRow : ConvRowBase {
+  TrefType(ConvRow);
+
+  int        id = 0;
+  uint16_t   level = 0;
+  uint16_t   flags = 0;
+  float      hp = 0;
+  string     name;
+  ConvPosDto pos;
+  TrefField(id);
+  TrefField(level);
+  TrefField(flags);
+  TrefField(hp);
+  TrefField(name);
+  TrefField(pos);
+};
+
+struct ConvPlayer {
+  TrefTypeWithMeta(ConvPlayer, MetaConvertStrict{});
+
+  int      id = 0;
+  uint16_t level = 0;
+  uint16_t flags = 0;
+  int      hidden = 7;  // not reflected, never written
+  double   hp = 0;
+  string   name;
+  ConvPos  pos;
+  TrefField(id);
+  TrefField(level);
+  TrefField(flags);
+  TrefField(hp);
+  TrefField(name);
+  TrefField(pos);
+};
+
+struct ConvPod {
+  TrefType(ConvPod);
+
+  int      id = 0;
+  uint16_t level = 0;
+  uint16_t flags = 0;
+  float    hp = 0;
+  TrefField(id);
+  TrefField(level);
+  TrefField(flags);
+  TrefField(hp);
+};
+
+static_assert(copy_runs_v<ConvPod, ConvPod>.count == 1);
+static_assert(copy_runs_v<ConvPod, ConvPod>.runs[0].size == sizeof(ConvPod));
+static_assert(imp::unmatched_fields_v<ConvPod, ConvPlayer> == 2);
+static_assert(imp::unmatched_fields_v<ConvPlayer, ConvPod> == 0);
+
+template <typename = void>
+void TestConvert() {
+  ConvRow row;
+  row.rowid = 99;
+  row.id = 1;
+  row.level = 2;
+  row.flags = 3;
+  row.hp = 4.5f;
+  row.name = "bob";
+  row.pos = {6, 5};
+
+  // id, level & flags are adjacent in both classes: one memcpy.
+  auto& runs = copy_runs_v<ConvRow, ConvPlayer>;
+  assert(runs.count == 1 && runs.runs[0].size == 8);
+
+  auto p = convert<ConvPlayer>(row);
+  assert(p.id == 1 && p.level == 2 && p.flags == 3 && p.hp == 4.5 && p.name == "bob");
+  assert(p.pos.x == 5 && p.pos.y == 6 && p.hidden == 7);
+
+  // unmatched fields are kept without MetaConvertStrict.
+  ConvRow back;
+  back.rowid = 42;
+  convert_into(p, back);
+  assert(back.rowid == 42 && back.id == 1 && back.hp == 4.5f && back.name == "bob");
+  assert(back.pos.x == 5 && back.pos.y == 6);
+
+  auto pod = convert<ConvPod>(p);
+  assert(pod.id == 1 && pod.level == 2 && pod.flags == 3 && pod.hp == 4.5f);
+}
+
+//////////////////////////////
+// bit packing
+
+struct BitPos {
+  TrefType(BitPos);
+
+  int x = 0, y = 0;
+  TrefFieldWithMeta(x, (MetaNumber{"pos x", -100, 100}));
+  TrefFieldWithMeta(y, (MetaNumber{"pos y", -100, 100}));
+};
+
+struct BitUnit {
+  TrefType(BitUnit);
+
+  int               id = 0;
+  bool              alive = false;
+  Perm              perm = Perm::None;
+  EnumA             kind = EnumA::Ass;
+  uint8_t           level = 1;
+  float             hp = 0;
+  float             speed = 1;
+  array<int16_t, 3> ammo{};
+  BitPos            pos;
+  TrefField(id);
+  TrefField(alive);
+  TrefField(perm);
+  TrefField(kind);
+  TrefFieldWithMeta(level, (MetaRange<uint8_t>{1, 100}));
+  TrefFieldWithMeta(hp, (MetaQuantized{0, 100, 10}));
+  TrefFieldWithMeta(speed, (MetaRange<float>{0, 10}));
+  TrefFieldWithMeta(ammo, (MetaRange<int16_t>{0, 999}));
+  TrefField(pos);
+};
+
+static_assert(bit_size_v<BitPos> == 16);
+static_assert(bit_size_v<BitUnit> == 32 + 1 + 3 + 1 + 7 + 10 + 32 + 3 * 10 + 16);
+
+TrefEnum(SparseFlags, unsigned, A = 1, C = 4);
+TrefEnumFlags(SparseFlags);
+
+struct BitSparse {
+  TrefType(BitSparse);
+
+  SparseFlags flags{};
+  TrefField(flags);
+};
+
+static_assert(bit_size_v<BitSparse> == 3);
+
+template <typename = void>
+void TestBitPacking() {
+  BitUnit u;
+  u.id = -5;
+  u.alive = true;
+  u.perm = Perm::ReadWrite;
+  u.kind = EnumA::Ban;
+  u.level = 100;
+  u.hp = 33.3f;
+  u.ammo = {0, 500, 999};
+  u.pos = {-100, 42};
+
+  string buf;
+  {
+    BitWriter w(buf);
+    assert(encode_bits(w, u) && encode_bits(w, u));
+  }
+  assert(buf.size() == (bit_size_v<BitUnit> * 2 + 7) / 8);
+
+  BitUnit   v[2];
+  BitReader r(buf);
+  assert(decode_bits(r, v[0]) && decode_bits(r, v[1]));
+  for (auto& d : v) {
+    assert(d.id == -5 && d.alive && d.perm == Perm::ReadWrite && d.kind == EnumA::Ban);
+    assert(d.level == 100 && d.hp > 33.2f && d.hp < 33.4f && d.speed == 1 && d.ammo == u.ammo);
+    assert(d.pos.x == -100 && d.pos.y == 42);
+  }
+
+  BitReader truncated(string_view(buf).substr(0, 10));
+  assert(!decode_bits(truncated, v[0]));
+
+  string    out;
+  BitWriter w(out);
+  u.pos.y = 101;
+  assert(!encode_bits(w, u));
+  u.pos.y = 0;
+  u.hp = -1;
+  assert(!encode_bits(w, u));
+  u.hp = 0;
+  u.speed = 11;
+  assert(!encode_bits(w, u));
+
+  string sparse;
+  {
+    BitWriter sw(sparse);
+    sw.write(2, 3);
+    sw.write(5, 3);
+  }
+  BitSparse s;
+  BitReader sr(sparse);
+  assert(!decode_bits(sr, s));
+  assert(decode_bits(sr, s) && s.flags == (SparseFlags::A | SparseFlags::C));
+}
+
+//////////////////////////////
+// batch validation
+
+struct ImportRow {
+  TrefType(ImportRow);
+
+  string   name;
+  int      x = 1;
+  uint16_t count = 0;
+  float    hp = 0;
+  TrefField(name);
+  TrefFieldWithMeta(x, (MetaNumber{"pos x", 1, 100}));
+  TrefFieldWithMeta(count, (MetaRange<int>{-10, 10}));
+  TrefFieldWithMeta(hp, (MetaQuantized{0, 100, 10}));
+};
+
+struct ImportNarrow {
+  TrefType(ImportNarrow);
+
+  uint8_t small = 0;
+  float   ratio = 0;
+  TrefFieldWithMeta(small, (MetaRange<int>{-5, 300}));
+  TrefFieldWithMeta(ratio, (MetaQuantized{0, 0.1, 8}));
+};
+
+template <typename = void>
+void TestValidate() {
+  vector<ImportRow> rows(130);
+  rows[3].x = 0;
+  rows[3].hp = -1;
+  rows[64].x = 101;
+  rows[100].count = 11;
+  rows[129].hp = numeric_limits<float>::quiet_NaN();
+
+  auto res = validate(rows);
+  assert(!res.ok() && res.failed.size() == 3);
+  for (size_t i = 0; i < rows.size(); i++)
+    assert(res.row_failed(i) == (i == 3 || i == 64 || i == 100 || i == 129));
+
+  assert(res.fields.size() == 3);
+  assert(res.fields[0].name == "x" && res.fields[0].index == 1);
+  assert((res.fields[0].rows == vector<uint32_t>{3, 64}));
+  assert((res.fields[1].rows == vector<uint32_t>{100}));
+  assert((res.fields[2].rows == vector<uint32_t>{3, 129}));
+
+  assert(validate(rows.data(), 3).ok());
+
+  // same results from the columns.
+  columns_t<ImportRow> cols;
+  for (auto& r : rows) {
+    get<0>(cols).push_back(r.name);
+    get<1>(cols).push_back(r.x);
+    get<2>(cols).push_back(r.count);
+    get<3>(cols).push_back(r.hp);
+  }
+  auto colRes = validate_columns<ImportRow>(cols);
+  assert(colRes.failed == res.failed && colRes.fields.size() == 3);
+  for (size_t i = 0; i < 3; i++)
+    assert(colRes.fields[i].index == res.fields[i].index && colRes.fields[i].rows == res.fields[i].rows);
+
+  // bounds out of the range of the column type, float bounds between two floats.
+  columns_t<ImportNarrow> narrow;
+  get<0>(narrow) = {0, 255, 7};
+  get<1>(narrow) = {0.1f, nextafter(0.1f, 0.f), -0.f};
+  auto nres = validate_columns<ImportNarrow>(narrow);
+  assert(nres.fields[0].rows.empty() && (nres.fields[1].rows == vector<uint32_t>{0}));
+  assert(validate(vector<ImportNarrow>{{0, 0.1f}}).fields[1].rows.size() == 1);
+  assert(validate_columns<ImportRow>({}).ok());
+}
+
+//////////////////////////////
+// batch encoding
+
+template <typename = void>
+void TestBatchCodec() {
+  vector<CsvRow> rows(10000);
+  for (size_t i = 0; i < rows.size(); i++) {
+    rows[i].id = int(i);
+    rows[i].name = string(i % 7, 'a');
+    rows[i].count = uint16_t(i);
+  }
+
+  string data;
+  encode_batch(data, rows, {4, 999});
+
+  vector<CsvRow> out(1);
+  assert(decode_batch(data, out, {3}) && out.size() == rows.size() + 1);
+  for (size_t i = 0; i < rows.size(); i++)
+    assert(out[i + 1].id == int(i) && out[i + 1].name == rows[i].name && out[i + 1].count == rows[i].count);
+
+  // same bytes with any thread count.
+  string single;
+  encode_batch(single, rows, {1, 999});
+  assert(single == data);
+
+  data.pop_back();
+  assert(!decode_batch(data, out) && out.size() == rows.size() + 1);
+
+  string empty;
+  encode_batch(empty, rows.data(), 0);
+  out.clear();
+  assert(decode_batch(empty, out) && out.empty());
+
+  // rows taking no bytes.
+  string           nothing;
+  vector<RpcEmpty> empties;
+  encode_batch(nothing, vector<RpcEmpty>(100), {2, 30});
+  assert(decode_batch(nothing, empties) && empties.size() == 100);
+}
+
+//////////////////////////////
+// hashed names & sidecar name table
+
+static_assert(class_info<TypeB>().get_field_index("foo") == 1);
+static_assert(enum_to_string(EnumA::Ban) == "Ban" && enum_to_string(EnumA::Ban) != "Ass");
+
+#if TrefHashNames
+
+static_assert(sizeof(class_info<TypeA>().name) == sizeof(uint32_t));
+// FNV-1a collisions, rejected in the fields of a class or the items of an enum.
+static_assert(!imp::unique_name_hashes(array<Name, 2>{"costarring", "liquid"}));
+static_assert(imp::unique_name_hashes(array<Name, 2>{"costarring", "liquids"}));
+
+// The names checked as text, normally loaded from the sidecar file.
+void LoadNameTable() {
+  string table;
+  for (string_view n : {"Mid", "High", "None", "Read", "Write", "Exec", "ReadWrite", "Data", "Child",
+                        "Child2", "SubChild", "TempSubChild", "SubChildOfTempSubChild1",
+                        "SubChildOfTempSubChild2", "SubChildOfTempSubChild3", "ExternalData",
+                        "Shape", "Circle", "Rect", "Square", "LayoutBase", "LayoutSplit", "pair",
+                        "value", "ref", "kind", "samples", "pos", "tag", "ok", "BulkA", "BulkB",
+                        "BulkC"}) {
+    char line[9];
+    snprintf(line, sizeof(line), "%08x", name_hash(n));
+    table.append(line).append(" ").append(n).append("\n");
+  }
+  load_name_table(table);
+  assert(class_info<Child>().name.str() == "Child" && enum_to_string(Perm::Exec).str() == "Exec");
+}
+
+#else
+
+template <typename = void>
+void TestNameTable() {
+  string table;
+  append_name_table<Perm>(table);
+  append_name_table<BulkBase>(table);
+  assert(table.find("\nRead\n") == string::npos);
+  char line[32];
+  snprintf(line, sizeof(line), "%08x Read\n", name_hash("Read"));
+  assert(table.find(line) != string::npos);
+  snprintf(line, sizeof(line), "%08x BulkC\n", name_hash("BulkC"));
+  assert(table.find(line) != string::npos);
+}
+
+#endif
+
 void TrefTest() {
+#if TrefHashNames
+  LoadNameTable();
+#endif
   TestEnum();
+  TestEnumContainers();
+  TestEnumFlags();
+  TestCsv();
+  TestRpcThunks();
+  TestRpcRouter();
+  TestProfiling();
   dumpTree<Base>();
   dumpDetails<Child2>();
   MetaExportedClass::dumpAll<Base>();
   TestHookable();
+  TestHookChain();
+  TestVisit();
+  TestClone();
+  TestCompiledPath();
+  TestRuntimeRegistry();
+  TestLayout();
+  TestBulkRegistration();
+  TestFlattenedLists();
+  TestExternClass();
+  TestConvert();
+  TestBitPacking();
+  TestValidate();
+  TestBatchCodec();
+#if !TrefHashNames
+  TestNameTable();
+#endif
 }
+
+// normally in one .cpp file
+TrefInstantiateClass(SharedRt);
+TrefInstantiateClass(SharedRtSub);